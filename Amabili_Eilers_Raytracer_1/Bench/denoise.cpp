@@ -0,0 +1,128 @@
+// Quality against time of the denoiser (see denoise.h) and of brute force
+// supersampling. Every scene is rendered once at a high supersampling factor
+// as the reference, then at low factors with and without denoising. The
+// error is the RMSE (and PSNR) of the clamped colors against the reference.
+// Tracing runs on one thread, the denoiser on all of them.
+//
+// Usage: bench-denoise [--reference N] scene.json...
+
+#include "denoise.h"
+#include "image.h"
+#include "raytracer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    Real rmse(Image const &img, Image const &reference)
+    {
+        double sum = 0;
+        for (unsigned y = 0; y != img.height(); ++y)
+            for (unsigned x = 0; x != img.width(); ++x)
+            {
+                Color a = img.load(x, y);
+                Color b = reference.load(x, y);
+                for (unsigned idx = 0; idx != 3; ++idx)
+                {
+                    double diff = min(max(a.data[idx], Real(0)), Real(1))
+                                - min(max(b.data[idx], Real(0)), Real(1));
+                    sum += diff * diff;
+                }
+            }
+        return sqrt(sum / (3.0 * img.size()));
+    }
+
+    struct Result
+    {
+        Image img;
+        double seconds;
+    };
+
+    Result render(Raytracer &raytracer, int superSampling, bool denoised)
+    {
+        Scene &scene = raytracer.getScene();
+        scene.setSuperSamplingFactor(superSampling);
+        Result result = { Image(raytracer.getWidth(), raytracer.getHeight()), 0 };
+
+        auto start = chrono::steady_clock::now();
+        scene.render(result.img);
+        if (denoised)
+        {
+            AuxBuffers aux(raytracer.getWidth(), raytracer.getHeight());
+            scene.renderAux(aux);
+            denoise(result.img, aux);
+        }
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        result.seconds = elapsed.count();
+        return result;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int referenceFactor = 8;
+    vector<string> scenes;
+    for (int idx = 1; idx != argc; ++idx)
+    {
+        string arg = argv[idx];
+        if (arg == "--reference" && idx + 1 != argc)
+            referenceFactor = max(1l, strtol(argv[++idx], nullptr, 10));
+        else
+            scenes.push_back(arg);
+    }
+    if (scenes.empty())
+    {
+        cerr << "Usage: " << argv[0] << " [--reference N] scene.json...\n";
+        return 1;
+    }
+
+    struct Variant
+    {
+        int superSampling;
+        bool denoised;
+    };
+    Variant const variants[] = {
+        { 1, false }, { 1, true }, { 2, false }, { 2, true }, { 4, false }
+    };
+
+    cout << "samples          seconds     RMSE     PSNR dB\n";
+    for (string const &file : scenes)
+    {
+        Raytracer raytracer;
+        streambuf *saved = cout.rdbuf(nullptr);     // quiet readScene
+        bool ok = raytracer.readScene(file);
+        cout.rdbuf(saved);
+        cout.clear();
+        if (!ok)
+        {
+            cerr << "Could not read " << file << '\n';
+            return 1;
+        }
+
+        Result reference = render(raytracer, referenceFactor, false);
+        cout << file << " (reference " << referenceFactor << 'x'
+             << referenceFactor << " in " << fixed << setprecision(3)
+             << reference.seconds << " s)\n";
+        for (Variant const &variant : variants)
+        {
+            Result result = render(raytracer, variant.superSampling,
+                                   variant.denoised);
+            Real error = rmse(result.img, reference.img);
+            cout << variant.superSampling << 'x' << variant.superSampling
+                 << (variant.denoised ? " denoised" : "         ")
+                 << setw(12) << setprecision(3) << result.seconds
+                 << setw(9) << setprecision(4) << error << setw(12)
+                 << setprecision(2)
+                 << (error > 0 ? -20 * log10(error) : INFINITY) << '\n';
+        }
+    }
+}
@@ -0,0 +1,145 @@
+// Scene load time per encoding: every scene is scaled up by repeating its
+// non-mesh objects, then read with Raytracer::readScene from memory as
+// JSON text, CBOR and MessagePack (see jsonstream.h). Mesh nodes are kept
+// once, their OBJ files cost the same in every encoding.
+//
+// Usage: bench-load [--scale N[,N...]] [--runs N] scene.json...
+
+#include "raytracer.h"
+
+#include "json/json.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using json = nlohmann::json;
+
+namespace
+{
+    json scaled(json const &scene, unsigned scale)
+    {
+        json out = scene;
+        json &objects = out["Objects"];
+        objects = json::array();
+        for (json const &object : scene["Objects"])
+            if (object["type"] == "mesh")
+                objects.push_back(object);
+        for (unsigned copy = 0; copy != scale; ++copy)
+            for (json const &object : scene["Objects"])
+                if (object["type"] != "mesh")
+                    objects.push_back(object);
+        return out;
+    }
+
+    // Best of runs, seconds
+    double timeLoad(string const &bytes, string const &directory, unsigned runs)
+    {
+        double best = 1e300;
+        for (unsigned run = 0; run != runs; ++run)
+        {
+            Raytracer raytracer;
+            istringstream in(bytes);
+            streambuf *saved = cout.rdbuf(nullptr);     // quiet readScene
+            auto start = chrono::steady_clock::now();
+            bool ok = raytracer.readScene(in, directory);
+            chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+            cout.rdbuf(saved);
+            cout.clear();
+            if (!ok)
+                return -1;
+            best = min(best, elapsed.count());
+        }
+        return best;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    vector<unsigned> scales = { 1, 100, 1000 };
+    unsigned runs = 3;
+    vector<string> scenes;
+    for (int idx = 1; idx != argc; ++idx)
+    {
+        string arg = argv[idx];
+        if (arg == "--scale" && idx + 1 != argc)
+        {
+            scales.clear();
+            for (char const *num = argv[++idx]; *num; )
+            {
+                char *end;
+                scales.push_back(strtoul(num, &end, 10));
+                num = *end == ',' ? end + 1 : end;
+                if (*end != ',' && *end != '\0')
+                    break;
+            }
+        }
+        else if (arg == "--runs" && idx + 1 != argc)
+            runs = max(1ul, strtoul(argv[++idx], nullptr, 10));
+        else
+            scenes.push_back(arg);
+    }
+    if (scenes.empty())
+    {
+        cerr << "Usage: " << argv[0]
+             << " [--scale N[,N...]] [--runs N] scene.json...\n";
+        return 1;
+    }
+
+    cout << "scale  objects  encoding        KiB      load ms\n";
+    for (string const &file : scenes)
+    {
+        ifstream in(file);
+        if (!in)
+        {
+            cerr << "Could not open " << file << '\n';
+            return 1;
+        }
+        json scene;
+        in >> scene;
+        size_t slash = file.find_last_of('/');
+        string directory = slash == string::npos ? "" : file.substr(0, slash + 1);
+
+        cout << file << '\n';
+        for (unsigned scale : scales)
+        {
+            json doc = scaled(scene, scale);
+            vector<uint8_t> cbor = json::to_cbor(doc);
+            vector<uint8_t> msgpack = json::to_msgpack(doc);
+            struct Encoding
+            {
+                char const *name;
+                string bytes;
+            };
+            Encoding encodings[] = {
+                { "json",    doc.dump() },
+                { "cbor",    string(cbor.begin(), cbor.end()) },
+                { "msgpack", string(msgpack.begin(), msgpack.end()) }
+            };
+
+            for (Encoding const &encoding : encodings)
+            {
+                double seconds = timeLoad(encoding.bytes, directory, runs);
+                if (seconds < 0)
+                {
+                    cerr << "Could not read " << file << " as "
+                         << encoding.name << '\n';
+                    return 1;
+                }
+                cout << setw(5) << scale << setw(9) << doc["Objects"].size()
+                     << "  " << left << setw(10) << encoding.name << right
+                     << setw(9) << encoding.bytes.size() / 1024
+                     << setw(13) << fixed << setprecision(2) << seconds * 1e3
+                     << '\n';
+            }
+        }
+    }
+}
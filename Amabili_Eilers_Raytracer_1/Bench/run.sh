@@ -0,0 +1,33 @@
+#!/bin/sh
+# Build the benchmark programs in the default and the padded Triple layout
+# and run them on the shipped scenes. Usage: Bench/run.sh [build-directory]
+set -e
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+build=${1:-$root/_bench}
+
+cmake -S "$root" -B "$build/default" -DRAY_BENCHMARKS=ON >/dev/null
+cmake -S "$root" -B "$build/padded" -DRAY_BENCHMARKS=ON \
+      -DRAY_PADDED_TRIPLE=ON >/dev/null
+cmake --build "$build/default"
+cmake --build "$build/padded"
+
+# scenes name their meshes relative to the Scenes directory
+cd "$root/Scenes"
+scenes="scene01-reflect-lights-shadows.json scene01-ss.json
+        scene01-texture-ss-reflect-lights-shadows.json"
+
+echo "== Triple math =="
+"$build/default/bench-triple"
+"$build/padded/bench-triple"
+
+echo "== Pixel traversal =="
+"$build/default/bench-traversal" --runs 5 $scenes scene02.json
+echo "-- padded Triple --"
+"$build/padded/bench-traversal" --runs 5 $scenes
+
+echo "== Scene load time =="
+"$build/default/bench-load" scene01.json scene01-lights-shadows.json
+
+echo "== Denoiser against supersampling =="
+"$build/default/bench-denoise" $scenes
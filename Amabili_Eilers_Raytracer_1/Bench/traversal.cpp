@@ -0,0 +1,180 @@
+// Render time and cache misses of every pixel traversal order (see
+// traversal.h) on a single thread. The misses are read from the kernel's
+// hardware counters (perf_event_open), they show as n/a where those are not
+// available, e.g. in containers and most virtual machines.
+//
+// Usage: bench-traversal [--tile size] [--runs N] scene.json...
+
+#include "image.h"
+#include "raytracer.h"
+#include "traversal.h"
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    // One hardware counter of this thread, inactive if the kernel refuses
+    class Counter
+    {
+        int d_fd;
+
+        public:
+            Counter(uint32_t type, uint64_t config)
+            {
+                perf_event_attr attr;
+                memset(&attr, 0, sizeof attr);
+                attr.size = sizeof attr;
+                attr.type = type;
+                attr.config = config;
+                attr.disabled = 1;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                d_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+            }
+
+            ~Counter()
+            {
+                if (d_fd != -1)
+                    close(d_fd);
+            }
+
+            bool active() const
+            {
+                return d_fd != -1;
+            }
+
+            void start()
+            {
+                if (d_fd == -1)
+                    return;
+                ioctl(d_fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(d_fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+
+            uint64_t stop()
+            {
+                uint64_t count = 0;
+                if (d_fd == -1)
+                    return 0;
+                ioctl(d_fd, PERF_EVENT_IOC_DISABLE, 0);
+                if (read(d_fd, &count, sizeof count) != sizeof count)
+                    return 0;
+                return count;
+            }
+    };
+
+    string count(Counter const &counter, uint64_t value)
+    {
+        if (!counter.active())
+            return "n/a";
+        ostringstream out;
+        out << value;
+        return out.str();
+    }
+
+    char const *name(Traversal order)
+    {
+        switch (order)
+        {
+            case Traversal::Morton:  return "morton";
+            case Traversal::Hilbert: return "hilbert";
+            default:                 return "rowmajor";
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned tileSize = 16;
+    unsigned runs = 3;
+    vector<string> scenes;
+    for (int idx = 1; idx != argc; ++idx)
+    {
+        string arg = argv[idx];
+        if (arg == "--tile" && idx + 1 != argc)
+            tileSize = strtoul(argv[++idx], nullptr, 10);
+        else if (arg == "--runs" && idx + 1 != argc)
+            runs = max(1ul, strtoul(argv[++idx], nullptr, 10));
+        else
+            scenes.push_back(arg);
+    }
+    if (scenes.empty())
+    {
+        cerr << "Usage: " << argv[0]
+             << " [--tile size] [--runs N] scene.json...\n";
+        return 1;
+    }
+
+    Counter l1Misses(PERF_TYPE_HW_CACHE,
+                     PERF_COUNT_HW_CACHE_L1D
+                     | PERF_COUNT_HW_CACHE_OP_READ << 8
+                     | PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    Counter llcMisses(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+
+    cout << "order       best s      L1d misses      LLC misses\n";
+    for (string const &file : scenes)
+    {
+        Raytracer raytracer;
+        streambuf *saved = cout.rdbuf(nullptr);     // quiet readScene
+        bool ok = raytracer.readScene(file);
+        cout.rdbuf(saved);
+        cout.clear();
+        if (!ok)
+        {
+            cerr << "Could not read " << file << '\n';
+            return 1;
+        }
+
+        cout << file << '\n';
+        Scene &scene = raytracer.getScene();
+        for (Traversal order : { Traversal::RowMajor, Traversal::Morton,
+                                 Traversal::Hilbert })
+        {
+            scene.setTraversal(order, tileSize);
+            Image img(raytracer.getWidth(), raytracer.getHeight());
+
+            // best of runs, the counters of that run
+            double best = 1e300;
+            uint64_t l1 = 0;
+            uint64_t llc = 0;
+            for (unsigned run = 0; run != runs; ++run)
+            {
+                l1Misses.start();
+                llcMisses.start();
+                auto start = chrono::steady_clock::now();
+                scene.render(img);
+                chrono::duration<double> elapsed =
+                    chrono::steady_clock::now() - start;
+                uint64_t runL1 = l1Misses.stop();
+                uint64_t runLlc = llcMisses.stop();
+                if (elapsed.count() < best)
+                {
+                    best = elapsed.count();
+                    l1 = runL1;
+                    llc = runLlc;
+                }
+            }
+
+            cout << left << setw(10) << name(order) << right << setw(8)
+                 << fixed << setprecision(3) << best << setw(16)
+                 << count(l1Misses, l1) << setw(16) << count(llcMisses, llc)
+                 << '\n';
+        }
+    }
+}
@@ -0,0 +1,127 @@
+// Microbenchmark of the Triple math: a Phong-like shading kernel (normalize,
+// dot, reflect, color arithmetic) over arrays of points, once with the
+// inline operators of triple.h and once through out-of-line functions like
+// the operators were before they moved into the header. Build once with and
+// once without RAY_PADDED_TRIPLE to compare the layouts (Bench/run.sh).
+//
+// Usage: bench-triple [iterations]
+
+#include "triple.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    unsigned const COUNT = 4096;        // points per pass, fits in L2
+
+    struct Input
+    {
+        vector<Point> hits;
+        vector<Vector> normals;
+        vector<Color> colors;
+        Point light;
+        Vector view;
+    };
+
+    Input makeInput()
+    {
+        mt19937 rng(1);
+        uniform_real_distribution<Real> dist(-1, 1);
+        Input in;
+        for (unsigned idx = 0; idx != COUNT; ++idx)
+        {
+            in.hits.push_back(Point(dist(rng), dist(rng), dist(rng)) * 100);
+            in.normals.push_back(Vector(dist(rng), dist(rng), dist(rng)).normalized());
+            in.colors.push_back(Color(dist(rng), dist(rng), dist(rng)) * 0.5 + 0.5);
+        }
+        in.light = Point(200, 400, 300);
+        in.view = Vector(0, 0, 1);
+        return in;
+    }
+
+    Color shadeInline(Input const &in)
+    {
+        Color sum;
+        for (unsigned idx = 0; idx != COUNT; ++idx)
+        {
+            Vector L = (in.light - in.hits[idx]).normalized();
+            Vector const &N = in.normals[idx];
+            Real diffuse = max(Real(0), N.dot(L));
+            Vector R = N * (2 * N.dot(L)) - L;
+            Real specular = max(Real(0), R.dot(in.view));
+            sum += in.colors[idx] * diffuse + Color(1, 1, 1) * (specular * 0.5);
+            sum += N.cross(L) * 1e-3;
+        }
+        return sum;
+    }
+
+    // The same operations as calls the compiler may not inline
+#define OUT_OF_LINE __attribute__((noinline))
+    OUT_OF_LINE Triple add(Triple const &a, Triple const &b) { return a + b; }
+    OUT_OF_LINE Triple sub(Triple const &a, Triple const &b) { return a - b; }
+    OUT_OF_LINE Triple mul(Triple const &a, Triple const &b) { return a * b; }
+    OUT_OF_LINE Triple scale(Triple const &a, Real f) { return a * f; }
+    OUT_OF_LINE Real dot(Triple const &a, Triple const &b) { return a.dot(b); }
+    OUT_OF_LINE Triple cross(Triple const &a, Triple const &b) { return a.cross(b); }
+    OUT_OF_LINE Triple normalized(Triple const &a) { return a.normalized(); }
+#undef OUT_OF_LINE
+
+    Color shadeOutOfLine(Input const &in)
+    {
+        Color sum;
+        for (unsigned idx = 0; idx != COUNT; ++idx)
+        {
+            Vector L = normalized(sub(in.light, in.hits[idx]));
+            Vector const &N = in.normals[idx];
+            Real diffuse = max(Real(0), dot(N, L));
+            Vector R = sub(scale(N, 2 * dot(N, L)), L);
+            Real specular = max(Real(0), dot(R, in.view));
+            sum = add(sum, add(mul(in.colors[idx], Color(diffuse, diffuse, diffuse)),
+                               scale(Color(1, 1, 1), specular * 0.5)));
+            sum = add(sum, scale(cross(N, L), 1e-3));
+        }
+        return sum;
+    }
+
+    // Best of five runs, nanoseconds per point
+    template <typename Kernel>
+    double time(Kernel kernel, Input const &in, unsigned iterations, Real &sink)
+    {
+        double best = 1e300;
+        for (unsigned run = 0; run != 5; ++run)
+        {
+            auto start = chrono::steady_clock::now();
+            for (unsigned it = 0; it != iterations; ++it)
+                sink += kernel(in).r;
+            chrono::duration<double, nano> elapsed =
+                chrono::steady_clock::now() - start;
+            best = min(best, elapsed.count() / (double(iterations) * COUNT));
+        }
+        return best;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned iterations = argc > 1 ? strtoul(argv[1], nullptr, 10) : 500;
+    Input in = makeInput();
+    Real sink = 0;
+
+    double inlined = time(shadeInline, in, iterations, sink);
+    double outOfLine = time(shadeOutOfLine, in, iterations, sink);
+
+    cout << "Triple: " << TRIPLE_LANES << " lanes of "
+         << (sizeof(Real) == 4 ? "float" : "double") << ", "
+         << sizeof(Triple) << " bytes\n"
+         << "  inline       " << inlined << " ns per point\n"
+         << "  out of line  " << outOfLine << " ns per point ("
+         << outOfLine / inlined << "x)\n"
+         << "  (checksum " << sink << ")\n";
+}
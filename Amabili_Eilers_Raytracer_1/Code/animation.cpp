@@ -0,0 +1,195 @@
+#include "animation.h"
+
+#include "arena.h"
+#include "scene.h"
+
+#include "json/json.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using namespace std;
+using json = nlohmann::json;
+
+// --- Track -------------------------------------------------------------------
+
+template <typename T>
+void Track<T>::add(Real frame, T const &value)
+{
+    auto pos = upper_bound(d_keys.begin(), d_keys.end(), frame,
+        [](Real f, pair<Real, T> const &key) { return f < key.first; });
+    d_keys.insert(pos, make_pair(frame, value));
+}
+
+template <typename T>
+bool Track<T>::empty() const
+{
+    return d_keys.empty();
+}
+
+template <typename T>
+T Track<T>::at(Real frame) const
+{
+    if (frame <= d_keys.front().first)
+        return d_keys.front().second;
+    if (frame >= d_keys.back().first)
+        return d_keys.back().second;
+
+    auto next = upper_bound(d_keys.begin(), d_keys.end(), frame,
+        [](Real f, pair<Real, T> const &key) { return f < key.first; });
+    auto prev = next - 1;
+    Real t = (frame - prev->first) / (next->first - prev->first);
+    return prev->second + (next->second - prev->second) * t;
+}
+
+template class Track<Real>;
+template class Track<Triple>;
+
+// --- Animation ---------------------------------------------------------------
+
+namespace
+{
+    // node[name], or null when there is no such member (the const
+    // operator[] of json requires it to exist)
+    json const &member(json const &node, char const *name)
+    {
+        static json const NONE;
+        auto iter = node.find(name);
+        return iter == node.end() ? NONE : *iter;
+    }
+
+    Real keyFrame(json const &key)
+    {
+        json const &frame = member(key, "frame");
+        if (!frame.is_number())
+            throw runtime_error("Animation key without a frame number");
+        return frame.get<Real>();
+    }
+
+    unsigned index(json const &node, char const *name, unsigned count)
+    {
+        json const &idx = member(node, name);
+        if (!idx.is_number_unsigned() || idx.get<unsigned>() >= count)
+            throw runtime_error(string("Animation: no such ") + name);
+        return idx.get<unsigned>();
+    }
+}
+
+Animation::Animation(json const &node, unsigned lightCount,
+                     unsigned objectCount)
+{
+    if (!member(node, "frames").is_number_unsigned())
+        throw runtime_error("Animation needs a number of frames");
+    d_frames = node["frames"].get<unsigned>();
+
+    for (json const &key : member(node, "Eye"))
+    {
+        json const &position = member(key, "position");
+        if (!position.is_array())
+            throw runtime_error("Animation: Eye key without a position");
+        d_eye.add(keyFrame(key), Point(position));
+    }
+
+    for (json const &lightNode : member(node, "Lights"))
+    {
+        LightTrack track;
+        track.light = index(lightNode, "light", lightCount);
+        for (json const &key : member(lightNode, "keys"))
+        {
+            if (key.count("position"))
+                track.position.add(keyFrame(key), Point(key["position"]));
+            if (key.count("color"))
+                track.color.add(keyFrame(key), Color(key["color"]));
+        }
+        d_lights.push_back(track);
+    }
+
+    for (json const &objectNode : member(node, "Objects"))
+    {
+        ObjectTrack track;
+        track.object = index(objectNode, "object", objectCount);
+        track.axis = objectNode.count("axis") ? Vector(objectNode["axis"])
+                                              : Vector(0.0, 1.0, 0.0);
+        if (track.axis.length_2() == 0)
+            throw runtime_error("Animation: object axis is zero");
+        track.pivot = objectNode.count("pivot") ? Point(objectNode["pivot"])
+                                                : Point();
+        for (json const &key : member(objectNode, "keys"))
+        {
+            if (key.count("rotate"))
+                track.rotate.add(keyFrame(key), key["rotate"].get<Real>());
+            if (key.count("translate"))
+                track.translate.add(keyFrame(key), Vector(key["translate"]));
+        }
+        d_objects.push_back(track);
+    }
+}
+
+unsigned Animation::frames() const
+{
+    return d_frames;
+}
+
+void Animation::pose(Real frame, Scene &scene, vector<Light> const &lights,
+                     vector<ObjectRange> const &objects)
+{
+    if (!d_eye.empty())
+        scene.setEye(d_eye.at(frame));
+
+    if (!d_lights.empty())
+    {
+        scene.clearLights();
+        for (unsigned idx = 0; idx != lights.size(); ++idx)
+        {
+            Point position = lights[idx].position;
+            Color color = lights[idx].color;
+            for (LightTrack const &track : d_lights)
+            {
+                if (track.light != idx)
+                    continue;
+                if (!track.position.empty())
+                    position = track.position.at(frame);
+                if (!track.color.empty())
+                    color = track.color.at(frame);
+            }
+            scene.addLight(Light(position, color));
+        }
+    }
+
+    // Transform from rest every frame, so rounding does not build up
+    // over long frame ranges
+    if (!d_arena)
+    {
+        d_arena = make_shared<Arena>();
+        for (ObjectTrack const &track : d_objects)
+        {
+            vector<ObjectPtr> &rest = d_rest[track.object];
+            if (!rest.empty())
+                continue;
+            ObjectRange const &range = objects[track.object];
+            for (unsigned idx = 0; idx != range.count; ++idx)
+                rest.push_back(scene.getObject(range.first + idx)->clone(*d_arena));
+        }
+    }
+
+    // the first track of an object starts at rest, further ones from there
+    vector<unsigned> posed;
+    for (ObjectTrack const &track : d_objects)
+    {
+        Real degrees = track.rotate.empty() ? 0.0 : track.rotate.at(frame);
+        Transform t(track.axis, degrees * M_PI / 180.0, track.pivot,
+                    track.translate.empty() ? Vector() : track.translate.at(frame));
+
+        bool fromRest = find(posed.begin(), posed.end(), track.object)
+                        == posed.end();
+        vector<ObjectPtr> const &rest = d_rest[track.object];
+        ObjectRange const &range = objects[track.object];
+        for (unsigned idx = 0; idx != range.count; ++idx)
+        {
+            ObjectPtr obj = scene.getObject(range.first + idx);
+            obj->transform(fromRest ? *rest[idx] : *obj, t);
+        }
+        posed.push_back(track.object);
+    }
+}
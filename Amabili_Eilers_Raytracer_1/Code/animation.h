@@ -0,0 +1,103 @@
+#ifndef ANIMATION_H_
+#define ANIMATION_H_
+
+#include "light.h"
+#include "object.h"
+#include "transform.h"
+#include "triple.h"
+
+#include "json/json_fwd.h"
+
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+class Arena;
+class Scene;
+
+// Keyframed value: linear between keys, held before the first and after
+// the last one
+template <typename T>
+class Track
+{
+    std::vector<std::pair<Real, T>> d_keys;     // by frame
+
+    public:
+        void add(Real frame, T const &value);
+        bool empty() const;
+        T at(Real frame) const;
+};
+
+// Scene objects built from one element of the "Objects" array, a mesh
+// gives many
+struct ObjectRange
+{
+    unsigned first;
+    unsigned count;
+};
+
+// The "Animation" member of a scene: a number of frames and keyframes for
+// the eye, lights and objects.
+//
+//  "Animation": {
+//      "frames": 48,
+//      "Eye": [{"frame": 0, "position": [...]}, ...],
+//      "Lights": [{"light": 0, "keys": [{"frame": 0, "position": [...],
+//                                        "color": [...]}, ...]}],
+//      "Objects": [{"object": 2, "axis": [0, 1, 0], "pivot": [...],
+//                   "keys": [{"frame": 0, "rotate": 0,
+//                             "translate": [0, 0, 0]}, ...]}]
+//  }
+//
+// Lights and objects are indices in the scene's arrays. Keys may give
+// only some of the values, the others are held or left at rest. Objects
+// turn by rotate degrees around axis through pivot, then move by translate,
+// relative to where the scene file puts them. Several tracks on one object
+// apply in the order they are listed.
+class Animation
+{
+    struct LightTrack
+    {
+        unsigned light;
+        Track<Point> position;
+        Track<Color> color;
+    };
+
+    struct ObjectTrack
+    {
+        unsigned object;
+        Vector axis;
+        Point pivot;
+        Track<Real> rotate;             // degrees
+        Track<Vector> translate;
+    };
+
+    unsigned d_frames = 0;
+    Track<Point> d_eye;
+    std::vector<LightTrack> d_lights;
+    std::vector<ObjectTrack> d_objects;
+    // copies of the animated objects as the scene file puts them, by
+    // element, every pose starts from these
+    std::shared_ptr<Arena> d_arena;
+    std::map<unsigned, std::vector<ObjectPtr>> d_rest;
+
+    public:
+        Animation() = default;
+
+        // Throws runtime_error on malformed keys or on lights and objects
+        // beyond the given counts
+        Animation(nlohmann::json const &node, unsigned lightCount,
+                  unsigned objectCount);
+
+        unsigned frames() const;        // 0: not animated
+
+        // Put everything where it is at frame. Animated objects (in
+        // objects, by element) are posed from copies of where they were at
+        // the first call, the lights are replaced by lights with their
+        // tracks applied.
+        void pose(Real frame, Scene &scene, std::vector<Light> const &lights,
+                  std::vector<ObjectRange> const &objects);
+};
+
+#endif
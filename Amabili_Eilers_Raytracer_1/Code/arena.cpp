@@ -0,0 +1,42 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+using namespace std;
+
+Arena::Arena(size_t blockSize)
+:
+    d_blockSize(blockSize)
+{}
+
+void *Arena::allocate(size_t size, size_t alignment)
+{
+    size_t pad = (alignment - reinterpret_cast<uintptr_t>(d_next) % alignment)
+                 % alignment;
+    if (pad + size > d_left)
+    {
+        size_t bytes = max(d_blockSize, size + alignment);
+        d_blocks.emplace_back(new char[bytes]);
+        d_next = d_blocks.back().get();
+        d_left = bytes;
+        pad = (alignment - reinterpret_cast<uintptr_t>(d_next) % alignment)
+              % alignment;
+    }
+
+    void *ptr = d_next + pad;
+    d_next += pad + size;
+    d_left -= pad + size;
+    d_used += size;
+    return ptr;
+}
+
+size_t Arena::bytesUsed() const
+{
+    return d_used;
+}
+
+size_t Arena::blockCount() const
+{
+    return d_blocks.size();
+}
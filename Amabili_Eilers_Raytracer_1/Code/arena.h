@@ -0,0 +1,44 @@
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bump allocator for things that live as long as a scene. Memory is taken
+// in large blocks and released all at once when the arena is destroyed.
+// Nothing is destroyed individually, so only trivially destructible types
+// can be created in it.
+class Arena
+{
+    std::vector<std::unique_ptr<char[]>> d_blocks;
+    char *d_next = nullptr;
+    size_t d_left = 0;
+    size_t d_blockSize;
+    size_t d_used = 0;
+
+    public:
+        explicit Arena(size_t blockSize = 1 << 20);
+
+        Arena(Arena const &) = delete;
+        Arena &operator=(Arena const &) = delete;
+
+        template <typename T, typename ...Args>
+        T *create(Args &&...args)
+        {
+            static_assert(std::is_trivially_destructible<T>::value,
+                          "objects in an Arena are never destroyed");
+            return new (allocate(sizeof(T), alignof(T)))
+                T(std::forward<Args>(args)...);
+        }
+
+        void *allocate(size_t size, size_t alignment);
+
+        size_t bytesUsed() const;
+        size_t blockCount() const;
+};
+
+#endif
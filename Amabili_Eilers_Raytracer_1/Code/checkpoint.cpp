@@ -0,0 +1,153 @@
+#include "checkpoint.h"
+
+#include "image.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace
+{
+    char const MAGIC[8] = {'R', 'A', 'Y', 'C', 'K', 'P', 'T', '1'};
+
+    struct Header
+    {
+        uint64_t sceneHash;
+        uint32_t realSize;
+        uint32_t format;
+        uint32_t pixelBytes;
+        uint32_t width;
+        uint32_t height;
+        uint32_t bandHeight;
+    };
+}
+
+Checkpoint::Checkpoint(string const &filename, Image &img,
+                       unsigned bandHeight, uint64_t sceneHash)
+:
+    d_filename(filename),
+    d_img(img),
+    d_bandHeight(bandHeight),
+    d_sceneHash(sceneHash),
+    d_done((img.height() + bandHeight - 1) / bandHeight, 0)
+{}
+
+unsigned Checkpoint::bands() const
+{
+    return d_done.size();
+}
+
+unsigned Checkpoint::bandHeight() const
+{
+    return d_bandHeight;
+}
+
+unsigned Checkpoint::doneCount() const
+{
+    unsigned count = 0;
+    for (unsigned char done : d_done)
+        count += done;
+    return count;
+}
+
+bool Checkpoint::done(unsigned band) const
+{
+    return d_done[band];
+}
+
+void Checkpoint::markDone(unsigned band)
+{
+    d_done[band] = 1;
+}
+
+bool Checkpoint::load()
+{
+    ifstream in(d_filename, ios::binary);
+    char magic[sizeof(MAGIC)];
+    Header header;
+    if (!in.read(magic, sizeof(magic))
+        || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0
+        || !in.read(reinterpret_cast<char *>(&header), sizeof(header)))
+        return false;
+
+    if (header.sceneHash != d_sceneHash
+        || header.realSize != sizeof(Real)
+        || header.format != static_cast<uint32_t>(d_img.format())
+        || header.pixelBytes != d_img.pixel_bytes()
+        || header.width != d_img.width()
+        || header.height != d_img.height()
+        || header.bandHeight != d_bandHeight)
+        return false;
+
+    vector<unsigned char> done(d_done.size());
+    if (!in.read(reinterpret_cast<char *>(done.data()), done.size()))
+        return false;
+
+    // Read into a copy so a truncated file leaves the image alone
+    Image img(d_img);
+    size_t rowBytes = img.width() * img.pixel_bytes();
+    for (unsigned band = 0; band != done.size(); ++band)
+    {
+        if (!done[band])
+            continue;
+        unsigned yEnd = min(img.height(), (band + 1) * d_bandHeight);
+        for (unsigned y = band * d_bandHeight; y != yEnd; ++y)
+            in.read(reinterpret_cast<char *>(img.raw_row(y)), rowBytes);
+    }
+    if (!in)
+        return false;
+
+    d_img = img;
+    d_done = done;
+    return true;
+}
+
+void Checkpoint::save() const
+{
+    string temp = d_filename + ".tmp";
+    {
+        ofstream out(temp, ios::binary);
+        if (!out)
+            throw runtime_error("Could not open " + temp + " for writing");
+
+        Header header = {
+            d_sceneHash, sizeof(Real),
+            static_cast<uint32_t>(d_img.format()),
+            static_cast<uint32_t>(d_img.pixel_bytes()),
+            d_img.width(), d_img.height(), d_bandHeight
+        };
+        out.write(MAGIC, sizeof(MAGIC));
+        out.write(reinterpret_cast<char const *>(&header), sizeof(header));
+        out.write(reinterpret_cast<char const *>(d_done.data()), d_done.size());
+
+        Image const &img = d_img;
+        size_t rowBytes = img.width() * img.pixel_bytes();
+        for (unsigned band = 0; band != d_done.size(); ++band)
+        {
+            if (!d_done[band])
+                continue;
+            unsigned yEnd = min(img.height(), (band + 1) * d_bandHeight);
+            for (unsigned y = band * d_bandHeight; y != yEnd; ++y)
+                out.write(reinterpret_cast<char const *>(img.raw_row(y)), rowBytes);
+        }
+
+        out.flush();
+        if (!out)
+            throw runtime_error("Writing checkpoint " + temp + " failed");
+    }
+
+    // rename replaces the old checkpoint in one step, a crash while writing
+    // leaves the previous one intact
+    if (rename(temp.c_str(), d_filename.c_str()) != 0)
+        throw runtime_error("Could not replace checkpoint " + d_filename);
+}
+
+void Checkpoint::remove() const
+{
+    std::remove(d_filename.c_str());
+    std::remove((d_filename + ".tmp").c_str());
+}
@@ -0,0 +1,44 @@
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Image;
+
+// Saves the finished bands of rows of an Image being rendered, so an
+// interrupted render can continue where it stopped. Pixels are stored in
+// the image's own format, restoring them gives the same bytes the render
+// would have produced. A checkpoint only matches the same scene (by hash),
+// image size, format, band height and precision.
+class Checkpoint
+{
+    std::string d_filename;
+    Image &d_img;
+    unsigned d_bandHeight;
+    uint64_t d_sceneHash;
+    std::vector<unsigned char> d_done;  // per band
+
+    public:
+        Checkpoint(std::string const &filename, Image &img,
+                   unsigned bandHeight, uint64_t sceneHash);
+
+        unsigned bands() const;
+        unsigned bandHeight() const;
+        unsigned doneCount() const;
+        bool done(unsigned band) const;
+        void markDone(unsigned band);
+
+        // Restore the image and done bands from the file, returns false
+        // (leaving everything untouched) if there is no matching checkpoint
+        bool load();
+
+        // Write the done bands, replacing the file atomically. Throws
+        // runtime_error if it cannot be written.
+        void save() const;
+
+        void remove() const;
+};
+
+#endif
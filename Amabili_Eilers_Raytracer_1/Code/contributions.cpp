@@ -0,0 +1,66 @@
+#include "contributions.h"
+
+#include <algorithm>
+
+using namespace std;
+
+ContributionMap::ContributionMap(unsigned width, unsigned height)
+:
+    d_width(width),
+    d_height(height),
+    d_first(size_t(width) * height),
+    d_count(size_t(width) * height)
+{}
+
+unsigned ContributionMap::width() const
+{
+    return d_width;
+}
+
+unsigned ContributionMap::height() const
+{
+    return d_height;
+}
+
+void ContributionMap::record(unsigned x, unsigned y, vector<uint32_t> &objects)
+{
+    sort(objects.begin(), objects.end());
+    objects.erase(unique(objects.begin(), objects.end()), objects.end());
+
+    // Re-recorded pixels append, their old entries are dropped once they
+    // outweigh the live ones
+    size_t idx = size_t(y) * d_width + x;
+    d_garbage += d_count[idx];
+    d_first[idx] = d_pool.size();
+    d_count[idx] = objects.size();
+    d_pool.insert(d_pool.end(), objects.begin(), objects.end());
+
+    if (d_garbage > d_pool.size() / 2 && d_garbage > 4096)
+        compact();
+}
+
+bool ContributionMap::touches(unsigned x, unsigned y,
+                              vector<bool> const &dirty) const
+{
+    size_t idx = size_t(y) * d_width + x;
+    uint32_t const *objects = d_pool.data() + d_first[idx];
+    for (uint32_t obj = 0; obj != d_count[idx]; ++obj)
+        if (objects[obj] < dirty.size() && dirty[objects[obj]])
+            return true;
+    return false;
+}
+
+void ContributionMap::compact()
+{
+    vector<uint32_t> pool;
+    pool.reserve(d_pool.size() - d_garbage);
+    for (size_t idx = 0; idx != d_first.size(); ++idx)
+    {
+        uint32_t first = pool.size();
+        pool.insert(pool.end(), d_pool.begin() + d_first[idx],
+                    d_pool.begin() + d_first[idx] + d_count[idx]);
+        d_first[idx] = first;
+    }
+    d_pool.swap(pool);
+    d_garbage = 0;
+}
@@ -0,0 +1,40 @@
+#ifndef CONTRIBUTIONS_H_
+#define CONTRIBUTIONS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Which scene objects (by index) the color of every pixel came from: the
+// first hit and each reflection of every sample. Filled by Scene::render
+// while attached with Scene::setContributions, so that after an edit of
+// some objects' materials only their pixels need tracing again.
+class ContributionMap
+{
+    unsigned d_width;
+    unsigned d_height;
+    // the objects of pixel p are d_pool[d_first[p], d_first[p] + d_count[p])
+    std::vector<uint32_t> d_first;
+    std::vector<uint32_t> d_count;
+    std::vector<uint32_t> d_pool;
+    size_t d_garbage = 0;               // pool entries no pixel refers to
+
+    public:
+        ContributionMap(unsigned width, unsigned height);
+
+        unsigned width() const;
+        unsigned height() const;
+
+        // Replace the objects of (x, y), frame coordinates with y pointing
+        // down. Sorts objects and drops duplicates.
+        void record(unsigned x, unsigned y, std::vector<uint32_t> &objects);
+
+        // Does the color of (x, y) depend on an object flagged in dirty
+        bool touches(unsigned x, unsigned y,
+                     std::vector<bool> const &dirty) const;
+
+    private:
+        void compact();
+};
+
+#endif
@@ -0,0 +1,132 @@
+#include "costmap.h"
+
+#include "image.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace
+{
+    // Black - blue - magenta - orange - yellow - white, like "inferno"
+    Color heat(float value)
+    {
+        static float const STOPS[6][3] = {
+            {0.00f, 0.00f, 0.02f}, {0.23f, 0.05f, 0.43f}, {0.58f, 0.15f, 0.40f},
+            {0.87f, 0.32f, 0.16f}, {0.99f, 0.65f, 0.04f}, {0.99f, 1.00f, 0.64f}
+        };
+
+        float pos = min(max(value, 0.0f), 1.0f) * 5.0f;
+        unsigned idx = min(static_cast<unsigned>(pos), 4u);
+        float frac = pos - idx;
+        return Color(
+            STOPS[idx][0] + (STOPS[idx + 1][0] - STOPS[idx][0]) * frac,
+            STOPS[idx][1] + (STOPS[idx + 1][1] - STOPS[idx][1]) * frac,
+            STOPS[idx][2] + (STOPS[idx + 1][2] - STOPS[idx][2]) * frac);
+    }
+
+    template <typename Field>
+    void writeHeatmap(string const &filename, vector<PixelCost> const &cost,
+                      unsigned width, unsigned height, Field field)
+    {
+        vector<float> values;
+        values.reserve(cost.size());
+        for (PixelCost const &pixel : cost)
+            values.push_back(field(pixel));
+
+        vector<float> sorted(values);
+        size_t rank = sorted.empty() ? 0 : (sorted.size() - 1) * 99 / 100;
+        nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+        float scale = sorted.empty() || sorted[rank] <= 0.0f
+            ? 0.0f : 1.0f / sorted[rank];
+
+        Image img(width, height, PixelFormat::RGB8);
+        for (unsigned y = 0; y != height; ++y)
+            for (unsigned x = 0; x != width; ++x)
+                img.store(x, y, heat(values[size_t(y) * width + x] * scale));
+        img.write_png(filename);
+    }
+}
+
+CostMap::CostMap(unsigned width, unsigned height)
+:
+    d_width(width),
+    d_height(height),
+    d_cost(size_t(width) * height, PixelCost{0.0f, 0.0f, 0.0f})
+{}
+
+unsigned CostMap::width() const
+{
+    return d_width;
+}
+
+unsigned CostMap::height() const
+{
+    return d_height;
+}
+
+void CostMap::record(unsigned x, unsigned y, PixelCost const &cost)
+{
+    d_cost[size_t(y) * d_width + x] = cost;
+}
+
+PixelCost const &CostMap::at(unsigned x, unsigned y) const
+{
+    return d_cost[size_t(y) * d_width + x];
+}
+
+void CostMap::write_pfm(string const &filename) const
+{
+    ofstream out(filename, ios::binary);
+    if (!out)
+        throw runtime_error("Could not open " + filename + " for writing");
+
+    // a negative scale marks little endian data, rows run bottom to top
+    out << "PF\n" << d_width << ' ' << d_height << "\n-1.0\n";
+    for (unsigned y = d_height; y-- != 0; )
+    {
+        for (unsigned x = 0; x != d_width; ++x)
+        {
+            PixelCost const &cost = at(x, y);
+            float channels[3] = {cost.tests, cost.rays, cost.nanoseconds};
+            unsigned char bytes[sizeof(channels)];
+            for (unsigned ch = 0; ch != 3; ++ch)
+            {
+                uint32_t bits;
+                memcpy(&bits, &channels[ch], sizeof(bits));
+                for (unsigned byte = 0; byte != 4; ++byte)
+                    bytes[ch * 4 + byte] = bits >> (8 * byte);
+            }
+            out.write(reinterpret_cast<char const *>(bytes), sizeof(bytes));
+        }
+    }
+
+    if (!out)
+        throw runtime_error("Writing " + filename + " failed");
+}
+
+void CostMap::write_heatmaps(string const &prefix) const
+{
+    writeHeatmap(prefix + "-time.png", d_cost, d_width, d_height,
+                 [](PixelCost const &cost) { return cost.nanoseconds; });
+    writeHeatmap(prefix + "-tests.png", d_cost, d_width, d_height,
+                 [](PixelCost const &cost) { return cost.tests; });
+    writeHeatmap(prefix + "-rays.png", d_cost, d_width, d_height,
+                 [](PixelCost const &cost) { return cost.rays; });
+}
+
+CostTotal CostMap::total() const
+{
+    CostTotal sum = {0, 0, 0.0};
+    for (PixelCost const &cost : d_cost)
+    {
+        sum.tests += uint64_t(cost.tests);
+        sum.rays += uint64_t(cost.rays);
+        sum.nanoseconds += cost.nanoseconds;
+    }
+    return sum;
+}
@@ -0,0 +1,56 @@
+#ifndef COSTMAP_H_
+#define COSTMAP_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// What one pixel cost to render
+struct PixelCost
+{
+    float tests;            // ray-object intersection tests
+    float rays;             // primary, shadow and reflection rays
+    float nanoseconds;
+};
+
+// Sum of the costs of every pixel of a CostMap
+struct CostTotal
+{
+    uint64_t tests;
+    uint64_t rays;
+    double nanoseconds;
+};
+
+// Per pixel render cost of a frame, filled by Scene::render while it is
+// attached with Scene::setCostMap
+class CostMap
+{
+    unsigned d_width;
+    unsigned d_height;
+    std::vector<PixelCost> d_cost;
+
+    public:
+        CostMap(unsigned width, unsigned height);
+
+        unsigned width() const;
+        unsigned height() const;
+
+        // (x, y) in frame coordinates, y pointing down like Image rows
+        void record(unsigned x, unsigned y, PixelCost const &cost);
+        PixelCost const &at(unsigned x, unsigned y) const;
+
+        // Raw float buffer as a little endian PFM (tests, rays, nanoseconds
+        // as the three channels), readable by most HDR tools and numpy
+        void write_pfm(std::string const &filename) const;
+
+        // False colour heatmaps prefix-time.png, prefix-tests.png and
+        // prefix-rays.png, each scaled to its 99th percentile so a few
+        // extreme pixels do not flatten the rest
+        void write_heatmaps(std::string const &prefix) const;
+
+        // Totals, for the summary line. Summed in 64 bits, a pixel's own
+        // counts are floats (exact below 2^24) like in the PFM.
+        CostTotal total() const;
+};
+
+#endif
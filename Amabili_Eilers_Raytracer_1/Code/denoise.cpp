@@ -0,0 +1,138 @@
+#include "denoise.h"
+
+#include "image.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using namespace std;
+
+namespace
+{
+    Real const KERNEL[5] = {1.0 / 16, 1.0 / 4, 3.0 / 8, 1.0 / 4, 1.0 / 16};
+
+    Real powInt(Real base, unsigned exponent)
+    {
+        Real result = 1.0;
+        for (; exponent != 0; exponent >>= 1, base *= base)
+            if (exponent & 1)
+                result *= base;
+        return result;
+    }
+}
+
+AuxBuffers::AuxBuffers(unsigned width, unsigned height)
+:
+    width(width),
+    height(height),
+    normal(size_t(width) * height),
+    depth(size_t(width) * height, 0.0),
+    albedo(size_t(width) * height)
+{}
+
+void AuxBuffers::write_png(string const &prefix) const
+{
+    Image normals(width, height);
+    Image depths(width, height);
+    Image albedos(width, height);
+
+    Real maxDepth = 0.0;
+    for (Real d : depth)
+        maxDepth = max(maxDepth, d);
+
+    for (unsigned y = 0; y != height; ++y)
+    {
+        for (unsigned x = 0; x != width; ++x)
+        {
+            size_t idx = size_t(y) * width + x;
+            normals.store(x, y, (normal[idx] + 1.0) * 0.5);
+            Real d = maxDepth > 0.0 ? depth[idx] / maxDepth : 0.0;
+            depths.store(x, y, Color(d, d, d));
+            albedos.store(x, y, albedo[idx]);
+        }
+    }
+
+    normals.write_png(prefix + "-normal.png");
+    depths.write_png(prefix + "-depth.png");
+    albedos.write_png(prefix + "-albedo.png");
+}
+
+void denoise(Image &img, AuxBuffers const &aux, DenoiseSettings const &settings)
+{
+    if (img.format() != PixelFormat::Float
+        || img.width() != aux.width || img.height() != aux.height)
+        throw runtime_error("denoise needs a Float image the size of aux");
+
+    int const w = img.width();
+    int const h = img.height();
+    Image source(img);
+    Real const colorScale = 1.0 / (settings.sigmaColor * settings.sigmaColor);
+    Real const albedoScale = 1.0 / (settings.sigmaAlbedo * settings.sigmaAlbedo);
+
+    for (unsigned iteration = 0; iteration != settings.iterations; ++iteration)
+    {
+        int const step = 1 << iteration;
+
+        parallelFor(h, [&](unsigned y)
+        {
+            Rgb32f *out = img.float_row(y);
+            for (int x = 0; x != w; ++x)
+            {
+                size_t p = size_t(y) * w + x;
+                Color cp = source.load(x, y);
+                Vector const &np = aux.normal[p];
+                Real zp = aux.depth[p];
+                Color const &ap = aux.albedo[p];
+
+                Color sum(0.0, 0.0, 0.0);
+                Real weights = 0.0;
+                for (int dy = -2; dy <= 2; ++dy)
+                {
+                    int qy = int(y) + dy * step;
+                    if (qy < 0 || qy >= h)
+                        continue;
+                    Rgb32f const *row = source.float_row(qy);
+
+                    for (int dx = -2; dx <= 2; ++dx)
+                    {
+                        int qx = x + dx * step;
+                        if (qx < 0 || qx >= w)
+                            continue;
+
+                        size_t q = size_t(qy) * w + qx;
+                        Real zq = aux.depth[q];
+                        Real weight = KERNEL[dx + 2] * KERNEL[dy + 2];
+
+                        // background only mixes with background
+                        if ((zp == 0.0) != (zq == 0.0))
+                            continue;
+                        if (zp != 0.0)
+                        {
+                            Real facing = max(Real(0.0), np.dot(aux.normal[q]));
+                            weight *= powInt(facing, settings.normalPower);
+                            weight *= exp(-fabs(zp - zq)
+                                          / (settings.sigmaDepth * zp * step));
+                            weight *= exp(-(ap - aux.albedo[q]).length_2()
+                                          * albedoScale);
+                        }
+
+                        Color cq(row[qx].r, row[qx].g, row[qx].b);
+                        weight *= exp(-(cp - cq).length_2() * colorScale);
+
+                        sum += cq * weight;
+                        weights += weight;
+                    }
+                }
+
+                Color result = weights > 0.0 ? sum / weights : cp;
+                out[x] = Rgb32f{ float(result.r), float(result.g),
+                                 float(result.b) };
+            }
+        });
+
+        if (iteration + 1 != settings.iterations)
+            source = img;
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef DENOISE_H_
+#define DENOISE_H_
+
+#include "triple.h"
+
+#include <string>
+#include <vector>
+
+class Image;
+
+// First hit features of every pixel (one ray through the pixel center),
+// rendered by Scene::renderAux and used to guide the denoiser
+struct AuxBuffers
+{
+    unsigned width;
+    unsigned height;
+    std::vector<Vector> normal;     // zero where the ray hits nothing
+    std::vector<Real> depth;        // distance along the ray, 0 for no hit
+    std::vector<Color> albedo;      // material color, black for no hit
+
+    AuxBuffers(unsigned width = 0, unsigned height = 0);
+
+    // Write prefix-normal.png, prefix-depth.png and prefix-albedo.png, the
+    // normals mapped from [-1, 1] to [0, 1] and the depth scaled to its
+    // maximum
+    void write_png(std::string const &prefix) const;
+};
+
+struct DenoiseSettings
+{
+    unsigned iterations = 4;        // a-trous passes, steps 1, 2, 4, ...
+    Real sigmaColor = 0.05;         // color difference that halves weight
+    Real sigmaDepth = 0.02;         // relative depth difference
+    Real sigmaAlbedo = 0.1;
+    unsigned normalPower = 64;      // weight is max(0, n_p . n_q)^power
+};
+
+// Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010): a 5x5 B3
+// spline kernel spread out by a doubling step, with each tap weighted down
+// by how much its color, normal, depth and albedo differ from the center
+// pixel. Filters the rows on all threads. img must be a Float image with
+// the size of aux.
+void denoise(Image &img, AuxBuffers const &aux,
+             DenoiseSettings const &settings = DenoiseSettings());
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef HASH_H_
+#define HASH_H_
+
+#include <cstdint>
+#include <string>
+
+// 64 bit FNV-1a, used to recognize scenes by their contents
+
+uint64_t const FNV1A_OFFSET = 14695981039346656037ull;
+
+inline uint64_t fnv1a(uint64_t hash, unsigned char byte)
+{
+    return (hash ^ byte) * 1099511628211ull;
+}
+
+inline uint64_t fnv1a(std::string const &data)
+{
+    uint64_t hash = FNV1A_OFFSET;
+    for (unsigned char ch : data)
+        hash = fnv1a(hash, ch);
+    return hash;
+}
+
+#endif
@@ -7,10 +7,10 @@
 class Hit
 {
     public:
-        double t;   // distance of hit
+        Real t;     // distance of hit
         Vector N;   // Normal at hit
 
-        Hit(double time, Vector const &normal)
+        Hit(Real time, Vector const &normal)
         :
             t(time),
             N(normal)
@@ -18,10 +18,10 @@ class Hit
 
         static Hit const NO_HIT()
         {
-            static Hit no_hit(std::numeric_limits<double>::quiet_NaN(),
-                              Vector(std::numeric_limits<double>::quiet_NaN(),
-                                     std::numeric_limits<double>::quiet_NaN(),
-                                     std::numeric_limits<double>::quiet_NaN()));
+            static Hit no_hit(std::numeric_limits<Real>::quiet_NaN(),
+                              Vector(std::numeric_limits<Real>::quiet_NaN(),
+                                     std::numeric_limits<Real>::quiet_NaN(),
+                                     std::numeric_limits<Real>::quiet_NaN()));
             return no_hit;
         }
 };
@@ -1,19 +1,117 @@
 #include "image.h"
 
 #include "lode/lodepng.h"
+#include <cmath>
+#include <cstring>
 #include <iostream>
 #include <fstream>
+#include <stdexcept>
 
 using namespace std;
 
-Image::Image(unsigned width, unsigned height)
+namespace
+{
+    // 4x4 Bayer matrix, thresholds for ordered dithering
+    unsigned char const bayer[4][4] =
+    {
+        {  0,  8,  2, 10 },
+        { 12,  4, 14,  6 },
+        {  3, 11,  1,  9 },
+        { 15,  7, 13,  5 }
+    };
+
+    // Quantize a channel to 8 bits, the dither offset spreads the
+    // rounding error over neighbouring pixels instead of banding
+    unsigned char quantize(Real value, unsigned x, unsigned y)
+    {
+        Real dither = (bayer[y & 3][x & 3] + 0.5) / 16.0;
+        Real level = floor(value * 255.0 + dither);
+        return static_cast<unsigned char>(fmin(fmax(level, 0.0), 255.0));
+    }
+
+    uint16_t toHalf(float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+
+        uint16_t sign = (bits >> 16) & 0x8000;
+        int exponent = ((bits >> 23) & 0xff) - 127 + 15;
+        uint32_t mantissa = bits & 0x7fffff;
+
+        if (((bits >> 23) & 0xff) == 0xff)         // inf / nan
+            return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+        if (exponent >= 31)                         // overflow -> inf
+            return sign | 0x7c00;
+        if (exponent <= 0)                          // subnormal or zero
+        {
+            if (exponent < -10)
+                return sign;
+            mantissa |= 0x800000;
+            unsigned shift = 14 - exponent;
+            uint16_t half = mantissa >> shift;
+            uint32_t rest = mantissa & ((1u << shift) - 1);
+            uint32_t halfway = 1u << (shift - 1);
+            if (rest > halfway || (rest == halfway && (half & 1)))
+                ++half;
+            return sign | half;
+        }
+
+        uint16_t half = sign | (exponent << 10) | (mantissa >> 13);
+        uint32_t rest = mantissa & 0x1fff;          // round to nearest even
+        if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+            ++half;                                 // may carry into exponent
+        return half;
+    }
+
+    float fromHalf(uint16_t half)
+    {
+        uint32_t sign = uint32_t(half & 0x8000) << 16;
+        uint32_t exponent = (half >> 10) & 0x1f;
+        uint32_t mantissa = half & 0x3ff;
+
+        uint32_t bits;
+        if (exponent == 0x1f)                       // inf / nan
+            bits = sign | 0x7f800000 | (mantissa << 13);
+        else if (exponent != 0)
+            bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+        else if (mantissa == 0)
+            bits = sign;
+        else                                        // subnormal
+        {
+            exponent = 127 - 15 + 1;
+            while (!(mantissa & 0x400))
+            {
+                mantissa <<= 1;
+                --exponent;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+        }
+
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+}
+
+Image::Image(unsigned width, unsigned height, PixelFormat format)
 :
-    d_pixels(width * height),
     d_width(width),
-    d_height(height)
-{}
+    d_height(height),
+    d_format(format)
+{
+    switch (format)
+    {
+        case PixelFormat::Float:   d_rgb32f.resize(size());   break;
+        case PixelFormat::RGB8:    d_rgb8.resize(size());     break;
+        case PixelFormat::RGBA16F:
+            d_rgba16f.resize(size(), Rgba16f{ 0, 0, 0, toHalf(1.0f) });
+            break;
+    }
+}
 
 Image::Image(string const &filename)
+:
+    d_format(PixelFormat::Float)
 {
     read_png(filename);
 }
@@ -21,23 +119,49 @@ Image::Image(string const &filename)
 // normal accessors
 void Image::put_pixel(unsigned x, unsigned y, Color const &c)
 {
-    (*this)(x, y) = c;
+    check(x, y);
+    store(x, y, c);
 }
 Color Image::get_pixel(unsigned x, unsigned y) const
 {
-    return (*this)(x, y);
+    check(x, y);
+    return load(x, y);
+}
+
+Image::Pixel::Pixel(Image &img, unsigned x, unsigned y)
+:
+    d_img(img),
+    d_x(x),
+    d_y(y)
+{}
+
+Image::Pixel::operator Color() const
+{
+    return d_img.get_pixel(d_x, d_y);
+}
+
+Image::Pixel &Image::Pixel::operator=(Color const &c)
+{
+    d_img.put_pixel(d_x, d_y, c);
+    return *this;
+}
+
+Image::Pixel &Image::Pixel::operator=(Pixel const &other)
+{
+    return *this = Color(other);
 }
 
 // Handier accessors
 // Usage: color = img(x,y);
 //        img(x,y) = color;
-Color const&Image::operator()(unsigned x, unsigned y) const
+Image::Pixel Image::operator()(unsigned x, unsigned y)
 {
-    return d_pixels.at(index(x, y));
+    return Pixel(*this, x, y);
 }
-Color &Image::operator()(unsigned x, unsigned y)
+
+Color const Image::operator()(unsigned x, unsigned y) const
 {
-    return d_pixels.at(index(x, y));
+    return get_pixel(x, y);
 }
 
 unsigned Image::width() const
@@ -50,50 +174,198 @@ unsigned Image::height() const
     return d_height;
 }
 
-unsigned Image::size() const
+size_t Image::size() const
+{
+    return size_t(d_width) * d_height;
+}
+
+PixelFormat Image::format() const
 {
-    return d_width * d_height;
+    return d_format;
 }
 
 // Normalized accessors, unsignederval is (0...1, 0...1)
 // usefull for texture access
-Color const &Image::colorAt(float x, float y) const
+Color Image::colorAt(float x, float y) const
 {
-    return d_pixels.at(findex(x, y));
+    size_t idx = findex(x, y);
+    return get_pixel(idx % d_width, idx / d_width);
 }
 
-void Image::write_png(std::string const &filename) const
+void Image::write_png(std::string const &filename,
+                      PngCompression compression) const
 {
-    vector<unsigned char> image;
-    image.reserve(size() * 4);  // reserves size (less allocations)
-    for (Color pixel : d_pixels)
+    // alpha is always 1, so the file is plain RGB
+    vector<unsigned char> image(size() * 3);
+    auto imgIter = image.begin();
+    for (unsigned y = 0; y != d_height; ++y)
     {
-        image.push_back(static_cast<unsigned char>(pixel.r * 255.0));
-        image.push_back(static_cast<unsigned char>(pixel.g * 255.0));
-        image.push_back(static_cast<unsigned char>(pixel.b * 255.0));
-        image.push_back(255);   // alpha is always 1
+        for (unsigned x = 0; x != d_width; ++x)
+        {
+            if (d_format == PixelFormat::RGB8)
+            {
+                Rgb8 const &pixel = d_rgb8[index(x, y)];
+                *imgIter++ = pixel.r;
+                *imgIter++ = pixel.g;
+                *imgIter++ = pixel.b;
+                continue;
+            }
+            Color pixel = load(x, y);
+            *imgIter++ = Png::toByte(pixel.r);
+            *imgIter++ = Png::toByte(pixel.g);
+            *imgIter++ = Png::toByte(pixel.b);
+        }
     }
 
-    lodepng::encode(filename, image, d_width, d_height);
+    ofstream out(filename, ios::binary);
+    if (!out)
+        throw runtime_error("Could not open " + filename + " for writing");
+    Png::encode(out, image.data(), d_width, d_height, 3, compression);
 }
 
 void Image::read_png(std::string const &filename)
 {
     vector<unsigned char> image;
-    lodepng::decode(image, d_width, d_height, filename);
-    d_pixels.reserve(size());
+    unsigned error = lodepng::decode(image, d_width, d_height, filename);
+    if (error)
+        throw runtime_error(filename + ": " + lodepng_error_text(error));
+    *this = Image(d_width, d_height, d_format);
 
     auto imgIter = image.begin();
-    while (imgIter != image.end())
+    for (size_t idx = 0; idx != size(); ++idx)
     {
-        double r = (*imgIter) / 255.0;
+        Real r = (*imgIter) / 255.0;
         ++imgIter;
-        double g = (*imgIter) / 255.0;
+        Real g = (*imgIter) / 255.0;
         ++imgIter;
-        double b = (*imgIter) / 255.0;
+        Real b = (*imgIter) / 255.0;
         ++imgIter;
         // Ignore Alpha
         ++imgIter;
-        d_pixels.push_back(Color(r, g, b));
+        store(idx % d_width, idx / d_width, Color(r, g, b));
+    }
+}
+
+// --- Unchecked bulk access ---------------------------------------------------
+
+void Image::store(unsigned x, unsigned y, Color const &c)
+{
+    switch (d_format)
+    {
+        case PixelFormat::Float:
+            d_rgb32f[index(x, y)] = Rgb32f{ float(c.r), float(c.g), float(c.b) };
+            break;
+        case PixelFormat::RGB8:
+            d_rgb8[index(x, y)] = Rgb8{ quantize(c.r, x, y),
+                                        quantize(c.g, x, y),
+                                        quantize(c.b, x, y) };
+            break;
+        case PixelFormat::RGBA16F:
+        {
+            Rgba16f &pixel = d_rgba16f[index(x, y)];
+            pixel.r = toHalf(c.r);
+            pixel.g = toHalf(c.g);
+            pixel.b = toHalf(c.b);
+            break;
+        }
+    }
+}
+
+Color Image::load(unsigned x, unsigned y) const
+{
+    switch (d_format)
+    {
+        case PixelFormat::RGB8:
+        {
+            Rgb8 const &pixel = d_rgb8[index(x, y)];
+            return Color(pixel.r / 255.0, pixel.g / 255.0, pixel.b / 255.0);
+        }
+        case PixelFormat::RGBA16F:
+        {
+            Rgba16f const &pixel = d_rgba16f[index(x, y)];
+            return Color(fromHalf(pixel.r), fromHalf(pixel.g),
+                         fromHalf(pixel.b));
+        }
+        default:
+        {
+            Rgb32f const &pixel = d_rgb32f[index(x, y)];
+            return Color(pixel.r, pixel.g, pixel.b);
+        }
     }
 }
+
+Rgb32f *Image::float_row(unsigned y)
+{
+    return &d_rgb32f[index(0, y)];
+}
+
+Rgb32f const *Image::float_row(unsigned y) const
+{
+    return &d_rgb32f[index(0, y)];
+}
+
+Rgb8 *Image::rgb8_row(unsigned y)
+{
+    return &d_rgb8[index(0, y)];
+}
+
+Rgb8 const *Image::rgb8_row(unsigned y) const
+{
+    return &d_rgb8[index(0, y)];
+}
+
+Rgba16f *Image::rgba16f_row(unsigned y)
+{
+    return &d_rgba16f[index(0, y)];
+}
+
+Rgba16f const *Image::rgba16f_row(unsigned y) const
+{
+    return &d_rgba16f[index(0, y)];
+}
+
+size_t Image::pixel_bytes() const
+{
+    switch (d_format)
+    {
+        case PixelFormat::RGB8:    return sizeof(Rgb8);
+        case PixelFormat::RGBA16F: return sizeof(Rgba16f);
+        default:                   return sizeof(Rgb32f);
+    }
+}
+
+unsigned char *Image::raw_row(unsigned y)
+{
+    return const_cast<unsigned char *>(
+        static_cast<Image const &>(*this).raw_row(y));
+}
+
+unsigned char const *Image::raw_row(unsigned y) const
+{
+    switch (d_format)
+    {
+        case PixelFormat::RGB8:
+            return reinterpret_cast<unsigned char const *>(rgb8_row(y));
+        case PixelFormat::RGBA16F:
+            return reinterpret_cast<unsigned char const *>(rgba16f_row(y));
+        default:
+            return reinterpret_cast<unsigned char const *>(float_row(y));
+    }
+}
+
+void Image::check(unsigned x, unsigned y) const
+{
+    if (x >= d_width || y >= d_height)
+        throw out_of_range("Image: pixel outside the image");
+}
+
+PixelFormat parsePixelFormat(string const &name)
+{
+    if (name == "float")
+        return PixelFormat::Float;
+    if (name == "rgb8")
+        return PixelFormat::RGB8;
+    if (name == "rgba16f")
+        return PixelFormat::RGBA16F;
+    throw runtime_error("Unknown framebuffer format: " + name);
+}
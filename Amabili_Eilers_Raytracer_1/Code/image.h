@@ -1,55 +1,136 @@
 #ifndef IMAGE_H_
 #define IMAGE_H_
 
+#include "png.h"
 #include "triple.h"
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <vector>
 
+// Storage format of the pixels of an Image
+enum class PixelFormat
+{
+    Float,      // 32 bit float per channel (12 bytes), for filtering
+    RGB8,       // 8 bits per channel, ordered dithering when storing
+    RGBA16F     // IEEE half float per channel, alpha is always 1
+};
+
+// Pixel layouts of the formats
+struct Rgb32f
+{
+    float r;
+    float g;
+    float b;
+};
+
+struct Rgb8
+{
+    unsigned char r;
+    unsigned char g;
+    unsigned char b;
+};
+
+struct Rgba16f
+{
+    uint16_t r;
+    uint16_t g;
+    uint16_t b;
+    uint16_t a;
+};
+
 class Image
 {
-    std::vector<Color> d_pixels;
+    // only the vector of d_format is used
+    std::vector<Rgb32f> d_rgb32f;
+    std::vector<Rgb8> d_rgb8;
+    std::vector<Rgba16f> d_rgba16f;
     unsigned d_width;
     unsigned d_height;
+    PixelFormat d_format;
 
     public:
-        Image(unsigned width = 0, unsigned height = 0);
+        Image(unsigned width = 0, unsigned height = 0,
+              PixelFormat format = PixelFormat::Float);
         Image(std::string const &filename);
 
-        // normal accessors
+        // normal accessors, bounds checked
         void put_pixel(unsigned x, unsigned y, Color const &c);
         Color get_pixel(unsigned x, unsigned y) const;
 
-        // Handier accessors
+        // A pixel of a non-const image, converts like store and load
+        class Pixel
+        {
+            Image &d_img;
+            unsigned d_x;
+            unsigned d_y;
+
+            public:
+                Pixel(Image &img, unsigned x, unsigned y);
+
+                operator Color() const;
+                Pixel &operator=(Color const &c);
+                Pixel &operator=(Pixel const &other);
+        };
+
+        // Handier accessors, bounds checked
         // Usage: color = img(x,y);
         //        img(x,y) = color;
-        Color const &operator()(unsigned x, unsigned y) const;
-        Color &operator()(unsigned x, unsigned y);
+        Pixel operator()(unsigned x, unsigned y);
+        Color const operator()(unsigned x, unsigned y) const;
 
         unsigned width() const;
         unsigned height() const;
-        unsigned size() const;
+        size_t size() const;
+        PixelFormat format() const;
 
         // Normalized accessors, unsignederval is (0...1, 0...1)
         // usefull for texture access
-        Color const &colorAt(float x, float y) const;
+        Color colorAt(float x, float y) const;
 
-        void write_png(std::string const &filename) const;
+        // Encoded on all threads, see Png::encode
+        void write_png(std::string const &filename,
+                       PngCompression compression = PngCompression::Default) const;
         void read_png(std::string const &filename);
 
+// --- Unchecked bulk access ---------------------------------------------------
+
+        // (x, y) must lie inside the image; store converts to the format
+        void store(unsigned x, unsigned y, Color const &c);
+        Color load(unsigned x, unsigned y) const;
+
+        // Row pointers (width() pixels), only for the matching format
+        Rgb32f *float_row(unsigned y);
+        Rgb32f const *float_row(unsigned y) const;
+        Rgb8 *rgb8_row(unsigned y);
+        Rgb8 const *rgb8_row(unsigned y) const;
+        Rgba16f *rgba16f_row(unsigned y);
+        Rgba16f const *rgba16f_row(unsigned y) const;
+
+        // The storage of row y in whatever format, width() * pixel_bytes()
+        // bytes, for saving and restoring an image verbatim
+        size_t pixel_bytes() const;
+        unsigned char *raw_row(unsigned y);
+        unsigned char const *raw_row(unsigned y) const;
+
     private:
-        inline unsigned index(unsigned x, unsigned y) const
+        inline size_t index(unsigned x, unsigned y) const
         {
-            return y * d_width + x;
+            return size_t(y) * d_width + x;
         }
 
-        inline unsigned findex(float x, float y) const
+        inline size_t findex(float x, float y) const
         {
             return index(
                 static_cast<unsigned>(x * (d_width - 1)),
                 static_cast<unsigned>(y * (d_height - 1)));
         }
 
+        void check(unsigned x, unsigned y) const;   // throws out_of_range
 };
 
+// "float", "rgb8" or "rgba16f", throws on anything else
+PixelFormat parsePixelFormat(std::string const &name);
+
 #endif
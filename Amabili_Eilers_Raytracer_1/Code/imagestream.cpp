@@ -0,0 +1,143 @@
+#include "imagestream.h"
+
+#include "image.h"
+#include "png.h"
+
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    bool endsWith(string const &str, string const &suffix)
+    {
+        return str.size() >= suffix.size()
+            && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    // --- PPM (P6) ------------------------------------------------------------
+
+    class PpmStream: public ImageStream
+    {
+        ofstream d_out;
+
+        public:
+            PpmStream(string const &filename, unsigned width, unsigned height)
+            :
+                ImageStream(width),
+                d_out(filename, ios::binary)
+            {
+                if (!d_out)
+                    throw runtime_error("Could not open " + filename);
+                d_out << "P6\n" << width << ' ' << height << "\n255\n";
+            }
+
+            void close() override
+            {
+                d_out.close();
+            }
+
+        protected:
+            void write_bytes(unsigned char const *rgb) override
+            {
+                d_out.write(reinterpret_cast<char const *>(rgb), 3 * width());
+            }
+    };
+
+    // --- PNG -----------------------------------------------------------------
+
+    // RGB8 PNG, the rows go through a PngEncoder: every batch of rows is
+    // filtered and deflated on all threads like Image::write_png does
+    class PngStream: public ImageStream
+    {
+        ofstream d_out;
+        PngEncoder d_encoder;
+
+        public:
+            PngStream(string const &filename, unsigned width, unsigned height,
+                      PngCompression compression)
+            :
+                ImageStream(width),
+                d_out(open(filename)),
+                d_encoder(d_out, width, height, 3, compression)
+            {}
+
+            void close() override
+            {
+                d_encoder.finish();
+                d_out.close();
+            }
+
+        protected:
+            void write_bytes(unsigned char const *rgb) override
+            {
+                d_encoder.write_row(rgb);
+            }
+
+        private:
+            static ofstream open(string const &filename)
+            {
+                ofstream out(filename, ios::binary);
+                if (!out)
+                    throw runtime_error("Could not open " + filename);
+                return out;
+            }
+    };
+}
+
+ImageStream::ImageStream(unsigned width)
+:
+    d_width(width),
+    d_bytes(3 * width)
+{}
+
+unsigned ImageStream::width() const
+{
+    return d_width;
+}
+
+void ImageStream::write_row(Color const *pixels)
+{
+    unsigned char *out = d_bytes.data();
+    for (unsigned x = 0; x != d_width; ++x)
+    {
+        *out++ = Png::toByte(pixels[x].r);
+        *out++ = Png::toByte(pixels[x].g);
+        *out++ = Png::toByte(pixels[x].b);
+    }
+    write_bytes(d_bytes.data());
+}
+
+void ImageStream::write_row(Image const &img, unsigned y)
+{
+    static_assert(sizeof(Rgb8) == 3, "RGB8 rows are written as they are");
+    if (img.width() != d_width)
+        throw runtime_error("ImageStream: row of another width");
+    if (img.format() == PixelFormat::RGB8)
+    {
+        write_bytes(reinterpret_cast<unsigned char const *>(img.rgb8_row(y)));
+        return;
+    }
+
+    // the same conversion as Image::write_png
+    unsigned char *out = d_bytes.data();
+    for (unsigned x = 0; x != d_width; ++x)
+    {
+        Color pixel = img.load(x, y);
+        *out++ = Png::toByte(pixel.r);
+        *out++ = Png::toByte(pixel.g);
+        *out++ = Png::toByte(pixel.b);
+    }
+    write_bytes(d_bytes.data());
+}
+
+ImageStreamPtr openImageStream(string const &filename,
+                               unsigned width, unsigned height,
+                               PngCompression compression)
+{
+    if (endsWith(filename, ".ppm"))
+        return ImageStreamPtr(new PpmStream(filename, width, height));
+    return ImageStreamPtr(new PngStream(filename, width, height, compression));
+}
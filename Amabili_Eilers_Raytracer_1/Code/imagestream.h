@@ -0,0 +1,49 @@
+#ifndef IMAGESTREAM_H_
+#define IMAGESTREAM_H_
+
+#include "png.h"
+#include "triple.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+class Image;
+
+// Writes an image row by row, top to bottom, without holding it in memory.
+// Used by Raytracer to stream images that are too large for an Image.
+class ImageStream
+{
+    unsigned d_width;
+    std::vector<unsigned char> d_bytes;     // scratch of write_row
+
+    public:
+        virtual ~ImageStream() = default;
+
+        unsigned width() const;
+
+        // Append the next row, width() pixels
+        void write_row(Color const *pixels);
+        // Append row y of img, which is width() pixels wide (RGB8 rows go
+        // out as they are)
+        void write_row(Image const &img, unsigned y);
+
+        // Finish the file, all rows must have been written
+        virtual void close() = 0;
+
+    protected:
+        explicit ImageStream(unsigned width);
+
+        // the next row, 3 * width() bytes
+        virtual void write_bytes(unsigned char const *rgb) = 0;
+};
+
+typedef std::unique_ptr<ImageStream> ImageStreamPtr;
+
+// A binary PPM stream for names ending in .ppm, a PNG stream otherwise.
+// Throws runtime_error if the file cannot be created.
+ImageStreamPtr openImageStream(std::string const &filename,
+                               unsigned width, unsigned height,
+                               PngCompression compression = PngCompression::Default);
+
+#endif
@@ -0,0 +1,492 @@
+#include "jsonstream.h"
+
+#include "hash.h"
+#include "json/json.h"
+
+#include <cctype>
+#include <fstream>
+#include <stdexcept>
+
+using namespace std;
+using json = nlohmann::json;
+
+namespace
+{
+    uint64_t const INDEFINITE = UINT64_MAX;
+
+    bool endsWith(string const &str, string const &suffix)
+    {
+        return str.size() >= suffix.size()
+            && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+}
+
+JsonStreamReader::JsonStreamReader(istream &in)
+:
+    d_in(in),
+    d_buffer(1 << 16),
+    d_hash(FNV1A_OFFSET)
+{}
+
+void JsonStreamReader::read(set<string> const &streamed,
+                            Callback const &onMember, Callback const &onElement)
+{
+    skipWhitespace();
+    int first = peek();
+
+    // CBOR maps are 0xa0 - 0xbb and 0xbf, MessagePack maps 0x80 - 0x8f,
+    // 0xde and 0xdf, a text document starts with '{'
+    if ((first >= 0xa0 && first <= 0xbb) || first == 0xbf)
+        d_encoding = SceneEncoding::Cbor;
+    else if ((first >= 0x80 && first <= 0x8f) || first == 0xde || first == 0xdf)
+        d_encoding = SceneEncoding::MessagePack;
+    else
+        d_encoding = SceneEncoding::Json;
+
+    if (d_encoding == SceneEncoding::Json)
+        readText(streamed, onMember, onElement);
+    else
+        readBinary(streamed, onMember, onElement);
+}
+
+size_t JsonStreamReader::bytesRead() const
+{
+    return d_bytes;
+}
+
+uint64_t JsonStreamReader::hash() const
+{
+    return d_hash;
+}
+
+SceneEncoding JsonStreamReader::encoding() const
+{
+    return d_encoding;
+}
+
+// --- Text --------------------------------------------------------------------
+
+void JsonStreamReader::readText(set<string> const &streamed,
+                                Callback const &onMember,
+                                Callback const &onElement)
+{
+    string raw;
+
+    expect('{');
+    skipWhitespace();
+    if (peek() == '}')
+    {
+        get();
+        return;
+    }
+
+    while (true)
+    {
+        skipWhitespace();
+        raw.clear();
+        captureString(raw);
+        string key = json::parse(raw).get<string>();
+
+        skipWhitespace();
+        expect(':');
+        skipWhitespace();
+
+        if (streamed.count(key) && peek() == '[')
+        {
+            get();
+            skipWhitespace();
+            if (peek() == ']')
+                get();
+            else
+            {
+                while (true)
+                {
+                    skipWhitespace();
+                    raw.clear();
+                    captureValue(raw);
+                    onElement(key, json::parse(raw));
+
+                    skipWhitespace();
+                    char ch = get();
+                    if (ch == ']')
+                        break;
+                    if (ch != ',')
+                        throw runtime_error("Expected ',' or ']' in array " + key);
+                }
+            }
+        }
+        else
+        {
+            raw.clear();
+            captureValue(raw);
+            onMember(key, json::parse(raw));
+        }
+
+        skipWhitespace();
+        char ch = get();
+        if (ch == '}')
+            break;
+        if (ch != ',')
+            throw runtime_error("Expected ',' or '}' after member " + key);
+    }
+}
+
+void JsonStreamReader::captureValue(string &raw)
+{
+    if (d_encoding == SceneEncoding::Cbor)
+    {
+        captureCbor(raw);
+        return;
+    }
+    if (d_encoding == SceneEncoding::MessagePack)
+    {
+        captureMsgpack(raw);
+        return;
+    }
+
+    int ch = peek();
+    if (ch == '"')
+    {
+        captureString(raw);
+        return;
+    }
+
+    if (ch != '{' && ch != '[')
+    {
+        // number, true, false or null: up to the next delimiter
+        while ((ch = peek()) != EOF && ch != ',' && ch != '}' && ch != ']'
+               && !isspace(ch))
+            raw += get();
+        return;
+    }
+
+    // object or array: up to the matching bracket
+    unsigned depth = 0;
+    do
+    {
+        ch = peek();
+        if (ch == '"')
+        {
+            captureString(raw);
+            continue;
+        }
+        raw += get();
+        if (ch == '{' || ch == '[')
+            ++depth;
+        else if (ch == '}' || ch == ']')
+            --depth;
+    }
+    while (depth != 0);
+}
+
+void JsonStreamReader::captureString(string &raw)
+{
+    if (peek() != '"')
+        throw runtime_error("Expected a string in scene file");
+
+    raw += get();
+    while (true)
+    {
+        char ch = get();
+        raw += ch;
+        if (ch == '\\')
+            raw += get();
+        else if (ch == '"')
+            return;
+    }
+}
+
+// --- CBOR and MessagePack ----------------------------------------------------
+
+void JsonStreamReader::readBinary(set<string> const &streamed,
+                                  Callback const &onMember,
+                                  Callback const &onElement)
+{
+    string raw;
+
+    uint64_t members = binaryHeader(true);
+    for (uint64_t member = 0; member != members && !binaryBreak(); ++member)
+    {
+        raw.clear();
+        captureValue(raw);
+        json key = decode(raw);
+        if (!key.is_string())
+            throw runtime_error("Scene members must have string keys");
+        string const &name = key.get_ref<string const &>();
+
+        if (streamed.count(name) && binaryArrayNext())
+        {
+            uint64_t elements = binaryHeader(false);
+            for (uint64_t idx = 0; idx != elements && !binaryBreak(); ++idx)
+            {
+                raw.clear();
+                captureValue(raw);
+                onElement(name, decode(raw));
+            }
+        }
+        else
+        {
+            raw.clear();
+            captureValue(raw);
+            onMember(name, decode(raw));
+        }
+    }
+}
+
+void JsonStreamReader::captureCbor(string &raw)
+{
+    unsigned char initial = get();
+    raw += initial;
+    unsigned major = initial >> 5;
+    unsigned info = initial & 31;
+
+    uint64_t argument = info;
+    if (info >= 24 && info <= 27)
+        argument = bigEndian(1 << (info - 24), &raw);
+    else if (info == 31)
+        argument = INDEFINITE;
+    else if (info > 27)
+        throw runtime_error("Malformed CBOR in scene file");
+
+    switch (major)
+    {
+        case 0:                 // integers
+        case 1:
+        case 7:                 // simple values and floats
+            break;
+        case 2:                 // byte and text strings
+        case 3:
+            if (argument != INDEFINITE)
+                captureBytes(raw, argument);
+            else
+                while (peek() != 0xff)
+                    captureCbor(raw);
+            break;
+        case 4:                 // arrays and maps
+        case 5:
+            if (argument != INDEFINITE)
+            {
+                uint64_t items = major == 5 ? 2 * argument : argument;
+                for (uint64_t idx = 0; idx != items; ++idx)
+                    captureCbor(raw);
+            }
+            else
+                while (peek() != 0xff)
+                    captureCbor(raw);
+            break;
+        case 6:                 // tag
+            captureCbor(raw);
+            break;
+    }
+
+    if (argument == INDEFINITE && major != 7)
+        raw += get();           // the break
+}
+
+void JsonStreamReader::captureMsgpack(string &raw)
+{
+    unsigned char type = get();
+    raw += type;
+
+    uint64_t items = 0;         // nested values that follow
+    if (type <= 0x7f || type >= 0xe0 || type == 0xc0 || type == 0xc2
+        || type == 0xc3)
+        return;                 // fixint, nil, false, true
+    else if (type <= 0x8f)
+        items = 2 * (type & 0x0f);
+    else if (type <= 0x9f)
+        items = type & 0x0f;
+    else if (type <= 0xbf)
+        captureBytes(raw, type & 0x1f);
+    else
+    {
+        switch (type)
+        {
+            case 0xc4: captureBytes(raw, bigEndian(1, &raw)); break;
+            case 0xc5: captureBytes(raw, bigEndian(2, &raw)); break;
+            case 0xc6: captureBytes(raw, bigEndian(4, &raw)); break;
+            case 0xc7: captureBytes(raw, bigEndian(1, &raw) + 1); break;
+            case 0xc8: captureBytes(raw, bigEndian(2, &raw) + 1); break;
+            case 0xc9: captureBytes(raw, bigEndian(4, &raw) + 1); break;
+            case 0xcc: case 0xd0: captureBytes(raw, 1); break;
+            case 0xcd: case 0xd1: captureBytes(raw, 2); break;
+            case 0xca: case 0xce: case 0xd2: captureBytes(raw, 4); break;
+            case 0xcb: case 0xcf: case 0xd3: captureBytes(raw, 8); break;
+            case 0xd4: captureBytes(raw, 2); break;
+            case 0xd5: captureBytes(raw, 3); break;
+            case 0xd6: captureBytes(raw, 5); break;
+            case 0xd7: captureBytes(raw, 9); break;
+            case 0xd8: captureBytes(raw, 17); break;
+            case 0xd9: captureBytes(raw, bigEndian(1, &raw)); break;
+            case 0xda: captureBytes(raw, bigEndian(2, &raw)); break;
+            case 0xdb: captureBytes(raw, bigEndian(4, &raw)); break;
+            case 0xdc: items = bigEndian(2, &raw); break;
+            case 0xdd: items = bigEndian(4, &raw); break;
+            case 0xde: items = 2 * bigEndian(2, &raw); break;
+            case 0xdf: items = 2 * bigEndian(4, &raw); break;
+            default:
+                throw runtime_error("Malformed MessagePack in scene file");
+        }
+    }
+
+    for (uint64_t idx = 0; idx != items; ++idx)
+        captureMsgpack(raw);
+}
+
+void JsonStreamReader::captureBytes(string &raw, uint64_t count)
+{
+    for (uint64_t idx = 0; idx != count; ++idx)
+        raw += get();
+}
+
+uint64_t JsonStreamReader::binaryHeader(bool map)
+{
+    unsigned char type = get();
+    if (d_encoding == SceneEncoding::Cbor)
+    {
+        if (type >> 5 != (map ? 5u : 4u))
+            throw runtime_error("Unexpected CBOR type in scene file");
+        unsigned info = type & 31;
+        if (info < 24)
+            return info;
+        if (info <= 27)
+            return bigEndian(1 << (info - 24));
+        if (info == 31)
+            return INDEFINITE;
+        throw runtime_error("Malformed CBOR in scene file");
+    }
+
+    if (map && type >= 0x80 && type <= 0x8f)
+        return type & 0x0f;
+    if (!map && type >= 0x90 && type <= 0x9f)
+        return type & 0x0f;
+    if (type == (map ? 0xde : 0xdc))
+        return bigEndian(2);
+    if (type == (map ? 0xdf : 0xdd))
+        return bigEndian(4);
+    throw runtime_error("Unexpected MessagePack type in scene file");
+}
+
+bool JsonStreamReader::binaryArrayNext()
+{
+    int type = peek();
+    if (d_encoding == SceneEncoding::Cbor)
+        return type >> 5 == 4;
+    return (type >= 0x90 && type <= 0x9f) || type == 0xdc || type == 0xdd;
+}
+
+bool JsonStreamReader::binaryBreak()
+{
+    if (d_encoding != SceneEncoding::Cbor || peek() != 0xff)
+        return false;
+    get();
+    return true;
+}
+
+uint64_t JsonStreamReader::bigEndian(unsigned bytes, string *raw)
+{
+    uint64_t value = 0;
+    for (unsigned idx = 0; idx != bytes; ++idx)
+    {
+        char ch = get();
+        if (raw)
+            *raw += ch;
+        value = value << 8 | static_cast<unsigned char>(ch);
+    }
+    return value;
+}
+
+json JsonStreamReader::decode(string const &raw) const
+{
+    switch (d_encoding)
+    {
+        case SceneEncoding::Cbor:
+            return json::from_cbor(raw.data(), raw.size());
+        case SceneEncoding::MessagePack:
+            return json::from_msgpack(raw.data(), raw.size());
+        default:
+            return json::parse(raw);
+    }
+}
+
+// --- Input -------------------------------------------------------------------
+
+int JsonStreamReader::peek()
+{
+    if (d_pos == d_end)
+    {
+        d_in.read(d_buffer.data(), d_buffer.size());
+        d_pos = 0;
+        d_end = d_in.gcount();
+        if (d_end == 0)
+            return EOF;
+    }
+    return static_cast<unsigned char>(d_buffer[d_pos]);
+}
+
+char JsonStreamReader::get()
+{
+    if (peek() == EOF)
+        throw runtime_error("Unexpected end of scene file");
+
+    char ch = d_buffer[d_pos++];
+    ++d_bytes;
+    d_hash = fnv1a(d_hash, ch);
+    return ch;
+}
+
+void JsonStreamReader::skipWhitespace()
+{
+    int ch;
+    while ((ch = peek()) != EOF && isspace(ch))
+        get();
+}
+
+void JsonStreamReader::expect(char ch)
+{
+    if (get() != ch)
+        throw runtime_error(string("Expected '") + ch + "' in scene file");
+}
+
+// --- Conversion --------------------------------------------------------------
+
+SceneEncoding sceneEncodingFor(string const &filename)
+{
+    if (endsWith(filename, ".cbor"))
+        return SceneEncoding::Cbor;
+    if (endsWith(filename, ".msgpack") || endsWith(filename, ".mpk"))
+        return SceneEncoding::MessagePack;
+    return SceneEncoding::Json;
+}
+
+void convertScene(string const &ifname, string const &ofname)
+{
+    ifstream in(ifname, ios::binary);
+    if (!in)
+        throw runtime_error("Could not open " + ifname);
+
+    // Rebuild the document from the streamed members, so any encoding
+    // is read the same way
+    json document = json::object();
+    JsonStreamReader reader(in);
+    reader.read({},
+        [&](string const &key, json const &value)
+        {
+            document[key] = value;
+        },
+        [](string const &, json const &) {});
+
+    ofstream out(ofname, ios::binary);
+    if (!out)
+        throw runtime_error("Could not open " + ofname + " for writing");
+
+    switch (sceneEncodingFor(ofname))
+    {
+        case SceneEncoding::Cbor:        json::to_cbor(document, out); break;
+        case SceneEncoding::MessagePack: json::to_msgpack(document, out); break;
+        default:                         out << document.dump(4) << '\n'; break;
+    }
+
+    if (!out)
+        throw runtime_error("Writing " + ofname + " failed");
+}
@@ -0,0 +1,88 @@
+#ifndef JSONSTREAM_H_
+#define JSONSTREAM_H_
+
+#include "json/json_fwd.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <set>
+#include <string>
+#include <vector>
+
+// Encodings of a scene document, all with the same (json) data model
+enum class SceneEncoding
+{
+    Json,
+    Cbor,
+    MessagePack
+};
+
+// Reads a JSON, CBOR or MessagePack object from a stream one top level
+// member at a time, without building a DOM of the whole document (the
+// encoding is recognized by the first byte). Members named in the streamed
+// set whose value is an array are not materialized: each element is parsed
+// on its own and handed to the element callback, so at most one element is
+// in memory. Everything else goes to the member callback as a whole.
+class JsonStreamReader
+{
+    typedef std::function<void(std::string const &key,
+                               nlohmann::json const &value)> Callback;
+
+    std::istream &d_in;
+    std::vector<char> d_buffer;
+    size_t d_pos = 0;
+    size_t d_end = 0;
+    size_t d_bytes = 0;                 // consumed so far
+    uint64_t d_hash;                    // FNV-1a of the consumed bytes
+    SceneEncoding d_encoding = SceneEncoding::Json;
+
+    public:
+        explicit JsonStreamReader(std::istream &in);
+
+        // Throws runtime_error (or a json exception) on malformed input
+        void read(std::set<std::string> const &streamed,
+                  Callback const &onMember, Callback const &onElement);
+
+        size_t bytesRead() const;
+        uint64_t hash() const;
+        SceneEncoding encoding() const;     // valid after read()
+
+    private:
+        void readText(std::set<std::string> const &streamed,
+                      Callback const &onMember, Callback const &onElement);
+        void readBinary(std::set<std::string> const &streamed,
+                        Callback const &onMember, Callback const &onElement);
+
+        int peek();                     // EOF at the end
+        char get();                     // throws at the end
+        void skipWhitespace();
+        void expect(char ch);
+
+        // Append the encoded bytes of the next value to raw (in the
+        // document's encoding)
+        void captureValue(std::string &raw);
+        void captureString(std::string &raw);
+        void captureCbor(std::string &raw);
+        void captureMsgpack(std::string &raw);
+        void captureBytes(std::string &raw, uint64_t count);
+
+        // Consume a binary map or array header, returning its size
+        // (UINT64_MAX for a CBOR container of indefinite length)
+        uint64_t binaryHeader(bool map);
+        bool binaryArrayNext();         // true if the peeked byte is an array
+        bool binaryBreak();             // consumes a CBOR break if present
+        uint64_t bigEndian(unsigned bytes, std::string *raw = nullptr);
+
+        nlohmann::json decode(std::string const &raw) const;
+};
+
+// Scene encoding from the file name: .cbor, .msgpack/.mpk, otherwise json
+SceneEncoding sceneEncodingFor(std::string const &filename);
+
+// Rewrite a scene in the encoding of ofname, reading any of the three.
+// Throws runtime_error on I/O errors.
+void convertScene(std::string const &ifname, std::string const &ofname);
+
+#endif
@@ -3,10 +3,8 @@
 
 #include "triple.h"
 
-// Declare LightPtr for use in Scene class
-#include <memory>
-class Light;
-typedef std::shared_ptr<Light> LightPtr;
+#include <cstddef>
+#include <vector>
 
 class Light
 {
@@ -21,4 +19,40 @@ class Light
         {}
 };
 
+// The lights of a scene as separate position and color arrays, so shading
+// streams over contiguous Reals and vectorizes across lights
+class LightArrays
+{
+    public:
+        std::vector<Real> x, y, z;      // positions
+        std::vector<Real> r, g, b;      // colors
+
+        void push_back(Light const &light)
+        {
+            x.push_back(light.position.x);
+            y.push_back(light.position.y);
+            z.push_back(light.position.z);
+            r.push_back(light.color.r);
+            g.push_back(light.color.g);
+            b.push_back(light.color.b);
+        }
+
+        void clear()
+        {
+            for (auto *v : {&x, &y, &z, &r, &g, &b})
+                v->clear();
+        }
+
+        size_t size() const
+        {
+            return x.size();
+        }
+
+        Light operator[](size_t idx) const
+        {
+            return Light(Point(x[idx], y[idx], z[idx]),
+                         Color(r[idx], g[idx], b[idx]));
+        }
+};
+
 #endif
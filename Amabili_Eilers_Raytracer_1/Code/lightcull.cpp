@@ -0,0 +1,95 @@
+#include "lightcull.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+
+using namespace std;
+
+bool LightCluster::behind(Point const &p, Vector const &N) const
+{
+    // the box corner furthest along N
+    Point corner(N.x > 0 ? hi.x : lo.x,
+                 N.y > 0 ? hi.y : lo.y,
+                 N.z > 0 ? hi.z : lo.z);
+    return (corner - p).dot(N) <= 0;
+}
+
+namespace
+{
+    // Spread the low 10 bits of v to every third bit
+    uint32_t spreadBits(uint32_t v)
+    {
+        v &= 0x3ff;
+        v = (v | (v << 16)) & 0x030000ff;
+        v = (v | (v << 8)) & 0x0300f00f;
+        v = (v | (v << 4)) & 0x030c30c3;
+        v = (v | (v << 2)) & 0x09249249;
+        return v;
+    }
+
+    // 10 bit grid coordinate of v in [lo, lo + extent]
+    uint32_t quantize(Real v, Real lo, Real extent)
+    {
+        if (extent <= 0)
+            return 0;
+        return uint32_t(min(Real(1023), (v - lo) / extent * 1024));
+    }
+}
+
+vector<LightCluster> clusterLights(LightArrays &lights, unsigned clusterSize)
+{
+    size_t n = lights.size();
+    vector<LightCluster> clusters;
+    if (n == 0)
+        return clusters;
+
+    Point lo(lights.x[0], lights.y[0], lights.z[0]);
+    Point hi = lo;
+    for (size_t idx = 0; idx != n; ++idx)
+    {
+        lo = Point(min(lo.x, lights.x[idx]), min(lo.y, lights.y[idx]),
+                   min(lo.z, lights.z[idx]));
+        hi = Point(max(hi.x, lights.x[idx]), max(hi.y, lights.y[idx]),
+                   max(hi.z, lights.z[idx]));
+    }
+    Vector extent = hi - lo;
+
+    vector<uint32_t> code(n);
+    for (size_t idx = 0; idx != n; ++idx)
+        code[idx] = spreadBits(quantize(lights.x[idx], lo.x, extent.x))
+                  | spreadBits(quantize(lights.y[idx], lo.y, extent.y)) << 1
+                  | spreadBits(quantize(lights.z[idx], lo.z, extent.z)) << 2;
+
+    vector<size_t> order(n);
+    iota(order.begin(), order.end(), 0);
+    stable_sort(order.begin(), order.end(),
+        [&](size_t a, size_t b) { return code[a] < code[b]; });
+
+    LightArrays sorted;
+    for (size_t idx : order)
+        sorted.push_back(lights[idx]);
+    lights = sorted;
+
+    for (size_t first = 0; first < n; first += clusterSize)
+    {
+        LightCluster cluster;
+        cluster.first = first;
+        cluster.count = unsigned(min<size_t>(clusterSize, n - first));
+        cluster.lo = Point(lights.x[first], lights.y[first], lights.z[first]);
+        cluster.hi = cluster.lo;
+        cluster.maxColor = 0;
+        for (size_t idx = first; idx != first + cluster.count; ++idx)
+        {
+            Point pos(lights.x[idx], lights.y[idx], lights.z[idx]);
+            cluster.lo = Point(min(cluster.lo.x, pos.x), min(cluster.lo.y, pos.y),
+                               min(cluster.lo.z, pos.z));
+            cluster.hi = Point(max(cluster.hi.x, pos.x), max(cluster.hi.y, pos.y),
+                               max(cluster.hi.z, pos.z));
+            cluster.maxColor = max(cluster.maxColor, max(lights.r[idx],
+                                   max(lights.g[idx], lights.b[idx])));
+        }
+        clusters.push_back(cluster);
+    }
+    return clusters;
+}
@@ -0,0 +1,45 @@
+#ifndef LIGHTCULL_H_
+#define LIGHTCULL_H_
+
+#include "light.h"
+#include "triple.h"
+
+#include <vector>
+
+// Skipping lights that cannot matter at a hit point. The Phong shading here
+// has no distance falloff, so what a light can add is bounded by its color
+// and by which side of the surface it is on, not by how far away it is.
+struct LightCulling
+{
+    // lights whose brightest channel adds less than this are dropped, 0
+    // keeps every light that adds anything
+    Real threshold = 0.0;
+    // with shadows and more lights left than this, only this many shadow
+    // rays are traced, spread over the lights by their contribution
+    // (0: one shadow ray per light)
+    unsigned shadowSamples = 0;
+    // drop lights below the horizon of the hit point. They cannot light
+    // the surface, but the specular term here still adds their highlight
+    // when R.V > 0, so this changes the image more than the rest.
+    bool horizon = false;
+};
+
+// Bounds of a run of consecutive lights in a LightArrays
+struct LightCluster
+{
+    size_t first;
+    unsigned count;
+    Point lo;
+    Point hi;
+    Real maxColor;      // brightest channel of any light in it
+
+    // true when every light lies on or behind the plane through p with
+    // normal N, so none of them lights the front of the surface
+    bool behind(Point const &p, Vector const &N) const;
+};
+
+// Sort the lights along a Morton curve through their bounding box and cut
+// them in clusters of clusterSize neighbours
+std::vector<LightCluster> clusterLights(LightArrays &lights, unsigned clusterSize);
+
+#endif
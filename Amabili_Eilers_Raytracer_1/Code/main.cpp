@@ -1,44 +1,176 @@
 #include "raytracer.h"
+#include "jsonstream.h"
+#include "region.h"
+#include "server.h"
+#include "texture.h"
 
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <exception>
 #include <iostream>
+#include <limits>
 #include <string>
+#include <vector>
 
 using namespace std;
 
+namespace
+{
+    int usage(char const *name)
+    {
+        cerr << "Usage: " << name << " in-file [out-file.png]"
+                " [--resume | --watch | --preview]"
+                " [--region x0,y0,x1,y1 | --tile i/N | --workers N"
+                " | --frames first-last | --deadline seconds]\n"
+             << "       " << name << " --merge out-file.png partial...\n"
+             << "       " << name << " --convert in-file out-file"
+                " (.json, .cbor or .msgpack)\n"
+             << "       " << name << " --serve socket-path\n";
+        return 1;
+    }
+
+    // A frame number at text: digits only, no sign or blanks, fitting an
+    // unsigned. Sets end past it, returns false if there is none.
+    bool parseFrame(char const *text, char const *&end, unsigned &frame)
+    {
+        if (!isdigit(static_cast<unsigned char>(*text)))
+            return false;
+        char *stop;
+        errno = 0;
+        unsigned long value = strtoul(text, &stop, 10);
+        if (errno == ERANGE || value > numeric_limits<unsigned>::max())
+            return false;
+        frame = value;
+        end = stop;
+        return true;
+    }
+}
+
 int main(int argc, char *argv[])
+try
 {
     cout << "Introduction to Computer Graphics - Raytracer\n\n";
 
-    if (argc < 2 || argc > 3)
+    if (argc == 3 && string(argv[1]) == "--serve")
     {
-        cerr << "Usage: " << argv[0] << "in-file [out-file.png]\n";
-        return 1;
+        RenderServer server(argv[2]);
+        return server.run() ? 0 : 1;
+    }
+
+    if (argc == 4 && string(argv[1]) == "--convert")
+    {
+        convertScene(argv[2], argv[3]);
+        return 0;
+    }
+
+    if (argc >= 4 && string(argv[1]) == "--merge")
+    {
+        mergePartials(vector<string>(argv + 3, argv + argc), argv[2]);
+        return 0;
     }
 
+    // split the arguments in file names and at most one option
+    vector<string> files;
+    string option;
+    string value;
+    bool resume = false;
+    bool watch = false;
+    bool preview = false;
+    for (int idx = 1; idx != argc; ++idx)
+    {
+        string arg = argv[idx];
+        if (arg.compare(0, 2, "--") != 0)
+            files.push_back(arg);
+        else if (arg == "--resume")
+            resume = true;
+        else if (arg == "--watch")
+            watch = true;
+        else if (arg == "--preview")
+            preview = true;
+        else if (option.empty() && idx + 1 != argc
+                 && (arg == "--region" || arg == "--tile" || arg == "--workers"
+                     || arg == "--frames" || arg == "--deadline"))
+        {
+            option = arg;
+            value = argv[++idx];
+        }
+        else
+            return usage(argv[0]);
+    }
+
+    if (files.size() < 1 || files.size() > 2
+        || watch + resume + preview + !option.empty() > 1)
+        return usage(argv[0]);
+
     Raytracer raytracer;
 
     // read the scene
-    if (!raytracer.readScene(argv[1]))
+    if (!raytracer.readScene(files[0]))
     {
-        cerr << "Error: reading scene from " << argv[1] <<
+        cerr << "Error: reading scene from " << files[0] <<
             " failed - no output generated.\n";
         return 1;
     }
 
+    // the only scene of the process, its texture budget is the process's
+    if (raytracer.getTextureBudget() != 0)
+        TextureCache::instance().setBudget(raytracer.getTextureBudget());
+
     // determine output name
     string ofname;
-    if (argc >= 3)
+    if (files.size() >= 2)
     {
-        ofname = argv[2];   // use the provided name
+        ofname = files[1];  // use the provided name
     }
     else
     {
-        ofname = argv[1];   // replace .json with .png
+        ofname = files[0];  // replace .json with .png (.part for partials)
         ofname.erase(ofname.begin() + ofname.find_last_of('.'), ofname.end());
-        ofname += ".png";
+        ofname += option == "--region" || option == "--tile" ? ".part" : ".png";
     }
 
-    raytracer.renderToFile(ofname);
+    if (watch)
+        raytracer.watch(files[0], ofname);
+    else if (preview)
+        raytracer.renderProgressive(ofname);
+    else if (option == "--region")
+        raytracer.renderRegion(ofname, parseRegion(value));
+    else if (option == "--tile")
+        raytracer.renderRegion(ofname, parseTile(value, raytracer.getWidth(),
+                                                 raytracer.getHeight()));
+    else if (option == "--frames")
+    {
+        // "first-last" or a single frame, and nothing else
+        char const *end;
+        unsigned first;
+        if (!parseFrame(value.c_str(), end, first))
+            return usage(argv[0]);
+        unsigned last = first;
+        if ((*end == '-' && !parseFrame(end + 1, end, last)) || *end != '\0')
+            return usage(argv[0]);
+        raytracer.renderFrames(ofname, first, last);
+    }
+    else if (option == "--deadline")
+    {
+        // seconds, a positive number and nothing else
+        char *end;
+        double seconds = strtod(value.c_str(), &end);
+        if (end == value.c_str() || *end != '\0' || !(seconds > 0)
+            || !isfinite(seconds))
+            return usage(argv[0]);
+        raytracer.renderDeadline(ofname, seconds);
+    }
+    else if (option == "--workers")
+        raytracer.renderDistributed(ofname, strtoul(value.c_str(), nullptr, 10));
+    else
+        raytracer.renderToFile(ofname, resume);
 
     return 0;
 }
+catch (exception const &ex)
+{
+    cerr << "Error: " << ex.what() << '\n';
+    return 1;
+}
@@ -3,18 +3,22 @@
 
 #include "triple.h"
 
+class Texture;
+
 class Material
 {
     public:
         Color color;        // base color
-        double ka;          // ambient intensity
-        double kd;          // diffuse intensity
-        double ks;          // specular intensity
-        double n;           // exponent for specular highlight size
+        Texture *texture = nullptr;         // replaces color when set,
+                                            // owned by the TextureCache
+        Real ka;            // ambient intensity
+        Real kd;            // diffuse intensity
+        Real ks;            // specular intensity
+        Real n;             // exponent for specular highlight size
 
         Material() = default;
 
-        Material(Color const &color, double ka, double kd, double ks, double n)
+        Material(Color const &color, Real ka, Real kd, Real ks, Real n)
         :
             color(color),
             ka(ka),
@@ -6,21 +6,60 @@
 // not really needed here, but deriving classes may need them
 #include "hit.h"
 #include "ray.h"
+#include "transform.h"
 #include "triple.h"
 
-#include <memory>
+#include <stdexcept>
+
+class Arena;
+
+// Objects live in the Arena of their Scene, which owns them
 class Object;
-typedef std::shared_ptr<Object> ObjectPtr;
+typedef Object *ObjectPtr;
+
+// Texture coordinates of a surface point, width is the size in uv units
+// of a footprint around it (to pick the mip level)
+struct TexCoord
+{
+    Real u;
+    Real v;
+    Real width;
+};
 
 class Object
 {
     public:
         Material material;
 
-        virtual ~Object() = default;
-
         virtual Hit intersect(Ray const &ray) = 0;  // must be implemented
                                                     // in derived class
+
+        // uv of hit (a point on the surface) and the uv size of a footprint
+        // that is footprint units wide there. Shapes without a mapping use
+        // the texel at (0, 0).
+        virtual TexCoord map(Point const &hit, Real footprint) const
+        {
+            return TexCoord{0.0, 0.0, 0.0};
+        }
+
+        // For animation, shapes that do not implement these cannot be
+        // animated: a copy of the shape allocated in arena, and putting
+        // the shape where rest (such a copy, or the shape itself) is,
+        // moved by t
+        virtual ObjectPtr clone(Arena &arena) const
+        {
+            throw std::runtime_error("This shape cannot be transformed");
+        }
+        virtual void transform(Object const &rest, Transform const &t)
+        {
+            throw std::runtime_error("This shape cannot be transformed");
+        }
+
+    protected:
+        // Never destroyed through an Object pointer: the arena releases
+        // its memory without running destructors, so shapes must stay
+        // trivially destructible
+        ~Object() = default;
 };
 
 #endif
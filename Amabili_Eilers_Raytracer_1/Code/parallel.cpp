@@ -0,0 +1,130 @@
+#include "parallel.h"
+
+#include <algorithm>
+
+using namespace std;
+
+ThreadPool::ThreadPool(unsigned threads)
+{
+    if (threads == 0)
+        threads = max(thread::hardware_concurrency(), 1u);
+    for (unsigned idx = 0; idx != threads; ++idx)
+        d_threads.emplace_back(&ThreadPool::work, this, idx);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard<mutex> lock(d_mutex);
+        d_stop = true;
+    }
+    d_wake.notify_all();
+    for (thread &worker : d_threads)
+        worker.join();
+}
+
+unsigned ThreadPool::size() const
+{
+    return d_threads.size();
+}
+
+void ThreadPool::submit(Task task)
+{
+    {
+        lock_guard<mutex> lock(d_mutex);
+        d_tasks.push_back(move(task));
+    }
+    d_wake.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    unique_lock<mutex> lock(d_mutex);
+    d_idle.wait(lock, [this]() { return d_tasks.empty() && d_running == 0; });
+
+    exception_ptr error;
+    swap(error, d_error);
+    if (error)
+        rethrow_exception(error);
+}
+
+void ThreadPool::work(unsigned worker)
+{
+    unique_lock<mutex> lock(d_mutex);
+    while (true)
+    {
+        d_wake.wait(lock, [this]() { return d_stop || !d_tasks.empty(); });
+        if (d_tasks.empty())
+            return;                     // stopping and nothing left
+
+        Task task = move(d_tasks.front());
+        d_tasks.pop_front();
+        ++d_running;
+        lock.unlock();
+
+        exception_ptr error;
+        try
+        {
+            task(worker);
+        }
+        catch (...)
+        {
+            error = current_exception();
+        }
+
+        lock.lock();
+        if (error && !d_error)
+            d_error = error;
+        if (--d_running == 0 && d_tasks.empty())
+            d_idle.notify_all();
+    }
+}
+
+TaskGroup::TaskGroup(ThreadPool &pool)
+:
+    d_pool(pool)
+{}
+
+TaskGroup::~TaskGroup()
+{
+    unique_lock<mutex> lock(d_mutex);
+    d_done.wait(lock, [this]() { return d_pending == 0; });
+}
+
+void TaskGroup::submit(function<void(unsigned worker)> task)
+{
+    {
+        lock_guard<mutex> lock(d_mutex);
+        ++d_pending;
+    }
+
+    d_pool.submit([this, task](unsigned worker)
+        {
+            exception_ptr error;
+            try
+            {
+                task(worker);
+            }
+            catch (...)
+            {
+                error = current_exception();
+            }
+
+            lock_guard<mutex> lock(d_mutex);
+            if (error && !d_error)
+                d_error = error;
+            if (--d_pending == 0)
+                d_done.notify_all();
+        });
+}
+
+void TaskGroup::wait()
+{
+    unique_lock<mutex> lock(d_mutex);
+    d_done.wait(lock, [this]() { return d_pending == 0; });
+
+    exception_ptr error;
+    swap(error, d_error);
+    if (error)
+        rethrow_exception(error);
+}
@@ -0,0 +1,118 @@
+#ifndef PARALLEL_H_
+#define PARALLEL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Run body(idx) for idx in [0, count) on all hardware threads. Indices are
+// handed out one at a time, so uneven work balances itself. Blocks until
+// every call has returned; the first exception thrown by body is rethrown
+// here (the remaining indices are skipped).
+template <typename Body>
+void parallelFor(unsigned count, Body const &body)
+{
+    unsigned nThreads = std::thread::hardware_concurrency();
+    if (nThreads == 0 || nThreads > count)
+        nThreads = count;
+
+    std::atomic<unsigned> next(0);
+    std::exception_ptr error;
+    std::mutex errorMutex;
+    auto worker = [&]()
+    {
+        for (unsigned idx = next++; idx < count; idx = next++)
+        {
+            try
+            {
+                body(idx);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error)
+                    error = std::current_exception();
+                next = count;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned idx = 1; idx < nThreads; ++idx)
+        threads.emplace_back(worker);
+    worker();                                   // this thread helps too
+    for (std::thread &thread : threads)
+        thread.join();
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+// Long lived worker threads for callers that run many jobs, e.g. batches
+// of renders (see renderer.h). A task gets the index of the worker that
+// runs it, so it can use per worker state without locking.
+class ThreadPool
+{
+    typedef std::function<void(unsigned worker)> Task;
+
+    std::vector<std::thread> d_threads;
+    std::deque<Task> d_tasks;
+    std::mutex d_mutex;
+    std::condition_variable d_wake;     // a task was queued or stopping
+    std::condition_variable d_idle;     // the last task finished
+    unsigned d_running = 0;
+    bool d_stop = false;
+    std::exception_ptr d_error;
+
+    public:
+        // threads == 0: one per hardware thread
+        explicit ThreadPool(unsigned threads = 0);
+        ~ThreadPool();                  // finishes the queued tasks
+
+        ThreadPool(ThreadPool const &) = delete;
+        ThreadPool &operator=(ThreadPool const &) = delete;
+
+        unsigned size() const;
+
+        void submit(Task task);
+
+        // Block until every submitted task has run, then rethrow the first
+        // exception one of them threw. Other users' tasks count too, see
+        // TaskGroup to wait for some tasks only.
+        void wait();
+
+    private:
+        void work(unsigned worker);
+};
+
+// A batch of tasks on a ThreadPool that may run other work as well: wait
+// returns when this batch is done and rethrows only its errors. Must not
+// be waited for from a task of the same pool.
+class TaskGroup
+{
+    ThreadPool &d_pool;
+    std::mutex d_mutex;
+    std::condition_variable d_done;
+    unsigned d_pending = 0;
+    std::exception_ptr d_error;
+
+    public:
+        explicit TaskGroup(ThreadPool &pool);
+        ~TaskGroup();                   // waits, dropping errors
+
+        TaskGroup(TaskGroup const &) = delete;
+        TaskGroup &operator=(TaskGroup const &) = delete;
+
+        void submit(std::function<void(unsigned worker)> task);
+
+        // Block until the group's tasks have run, then rethrow the first
+        // exception one of them threw
+        void wait();
+};
+
+#endif
@@ -0,0 +1,398 @@
+#include "png.h"
+
+#include "parallel.h"
+#include "lode/lodepng.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <ostream>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    void writeUint32(unsigned char *out, unsigned value)
+    {
+        out[0] = (value >> 24) & 0xff;
+        out[1] = (value >> 16) & 0xff;
+        out[2] = (value >> 8) & 0xff;
+        out[3] = value & 0xff;
+    }
+
+    unsigned char paeth(int a, int b, int c)
+    {
+        int p = a + b - c;
+        int pa = abs(p - a);
+        int pb = abs(p - b);
+        int pc = abs(p - c);
+        if (pa <= pb && pa <= pc)
+            return a;
+        return pb <= pc ? b : c;
+    }
+
+    // Predictor of filter Type for byte i of row
+    template <unsigned Type>
+    unsigned char predict(unsigned char const *row, unsigned char const *prev,
+                          size_t i, unsigned bpp)
+    {
+        int a = i >= bpp ? row[i - bpp] : 0;            // left
+        int b = prev ? prev[i] : 0;                     // up
+        int c = i >= bpp && prev ? prev[i - bpp] : 0;   // up left
+        switch (Type)
+        {
+            case 1:  return a;
+            case 2:  return b;
+            case 3:  return (a + b) / 2;
+            case 4:  return paeth(a, b, c);
+            default: return 0;
+        }
+    }
+
+    // Sum of the residues of filter Type as signed bytes (the minimum sum
+    // heuristic), optionally writing the filtered bytes to out
+    template <unsigned Type>
+    size_t applyFilter(unsigned char *out, unsigned char const *row,
+                       unsigned char const *prev, size_t size, unsigned bpp)
+    {
+        size_t sum = 0;
+        for (size_t i = 0; i != size; ++i)
+        {
+            unsigned char residue = row[i] - predict<Type>(row, prev, i, bpp);
+            sum += abs(static_cast<signed char>(residue));
+            if (out)
+                out[i] = residue;
+        }
+        return sum;
+    }
+
+    typedef size_t (*Filter)(unsigned char *, unsigned char const *,
+                             unsigned char const *, size_t, unsigned);
+    Filter const filters[] = { applyFilter<0>, applyFilter<1>, applyFilter<2>,
+                               applyFilter<3>, applyFilter<4> };
+
+    // Rows per block of the parallel encoder, blocks much smaller than the
+    // deflate window compress badly
+    unsigned const MIN_BLOCK_BYTES = 1 << 17;
+
+    // Largest IDAT chunk written
+    size_t const MAX_CHUNK = 1 << 20;
+
+    struct Block
+    {
+        unsigned firstRow;
+        unsigned rows;
+        vector<unsigned char> filtered;     // filter byte + row, per row
+        vector<unsigned char> compressed;   // raw deflate data
+        unsigned adler;                     // adler32 of filtered
+    };
+
+    // Filter the rows of a block, rows points at its first row and prev at
+    // the row above it (nullptr at the top of the image)
+    void filterBlock(Block &block, unsigned char const *rows,
+                     unsigned char const *prev, size_t stride, unsigned bpp)
+    {
+        block.filtered.resize(block.rows * (stride + 1));
+        for (unsigned idx = 0; idx != block.rows; ++idx)
+        {
+            unsigned char const *row = rows + idx * stride;
+            Png::filterRow(&block.filtered[idx * (stride + 1)], row,
+                           idx == 0 ? prev : row - stride, stride, bpp);
+        }
+        block.adler = adler32(adler32(0, nullptr, 0), block.filtered.data(),
+                              block.filtered.size());
+    }
+
+    // Preset dictionary of a deflate block
+    typedef pair<unsigned char const *, size_t> Dictionary;
+
+    // The last 32 KiB of a block's filtered bytes, the dictionary of the
+    // block after it
+    Dictionary tail(Block const &block)
+    {
+        size_t size = min<size_t>(block.filtered.size(), 32768);
+        return Dictionary(block.filtered.data() + block.filtered.size() - size,
+                          size);
+    }
+
+    // Deflate a block as raw deflate data. Blocks are primed with the tail
+    // of the previous block as dictionary; all but the last end on a byte
+    // boundary (sync flush) so they can simply be concatenated.
+    void deflateBlock(Block &block, Dictionary dict, bool last, int level)
+    {
+        z_stream zs = z_stream();
+        if (deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY)
+            != Z_OK)
+            throw runtime_error("Png::encode: deflateInit2 failed");
+
+        if (dict.second != 0)
+            deflateSetDictionary(&zs, dict.first, dict.second);
+
+        block.compressed.resize(deflateBound(&zs, block.filtered.size()) + 16);
+        zs.next_in = block.filtered.data();
+        zs.avail_in = block.filtered.size();
+        zs.next_out = block.compressed.data();
+        zs.avail_out = block.compressed.size();
+        int status = deflate(&zs, last ? Z_FINISH : Z_SYNC_FLUSH);
+        block.compressed.resize(block.compressed.size() - zs.avail_out);
+        deflateEnd(&zs);
+
+        if (status != (last ? Z_STREAM_END : Z_OK))
+            throw runtime_error("Png::encode: deflate failed");
+    }
+
+    // Rows per block for rows of stride bytes
+    unsigned blockRows(size_t stride)
+    {
+        return max<size_t>(1, MIN_BLOCK_BYTES / (stride + 1));
+    }
+
+    // The two byte zlib header for a zlib level
+    void zlibHeader(vector<unsigned char> &stream, int zlibLevel)
+    {
+        unsigned char flevel = zlibLevel < 2 ? 0 : zlibLevel < 6 ? 1
+                             : zlibLevel == 6 ? 2 : 3;
+        unsigned header = (0x78 << 8) | (flevel << 6);
+        header += 31 - header % 31;
+        stream.push_back(header >> 8);
+        stream.push_back(header & 0xff);
+    }
+
+    void writeIdat(ostream &out, vector<unsigned char> const &stream)
+    {
+        for (size_t pos = 0; pos < stream.size(); pos += MAX_CHUNK)
+            Png::writeChunk(out, "IDAT", stream.data() + pos,
+                            min(MAX_CHUNK, stream.size() - pos));
+    }
+}
+
+void Png::encode(ostream &out, unsigned char const *pixels,
+                 unsigned width, unsigned height, unsigned channels,
+                 PngCompression compression)
+{
+    size_t stride = size_t(width) * channels;
+
+    // Split the rows in blocks
+    unsigned rows = blockRows(stride);
+    vector<Block> blocks;
+    for (unsigned row = 0; row < height; row += rows)
+        blocks.push_back(Block{ row, min(rows, height - row), {}, {}, 0 });
+
+    // Filtering only reads the unfiltered pixels, so all blocks can go at
+    // once. Deflating needs the previous block's filtered tail.
+    parallelFor(blocks.size(), [&](unsigned idx)
+    {
+        unsigned char const *first = pixels + blocks[idx].firstRow * stride;
+        filterBlock(blocks[idx], first, idx == 0 ? nullptr : first - stride,
+                    stride, channels);
+    });
+    parallelFor(blocks.size(), [&](unsigned idx)
+    {
+        deflateBlock(blocks[idx],
+                     idx == 0 ? Dictionary(nullptr, 0) : tail(blocks[idx - 1]),
+                     idx + 1 == blocks.size(), level(compression));
+    });
+
+    // zlib header, the concatenated deflate blocks and the combined adler32
+    vector<unsigned char> stream;
+    zlibHeader(stream, level(compression));
+    unsigned adler = adler32(0, nullptr, 0);
+    for (Block const &block : blocks)
+    {
+        stream.insert(stream.end(), block.compressed.begin(),
+                      block.compressed.end());
+        adler = adler32_combine(adler, block.adler, block.filtered.size());
+    }
+    if (blocks.empty())             // no rows: an empty final block
+    {
+        stream.push_back(0x03);
+        stream.push_back(0x00);
+    }
+    unsigned char trailer[4];
+    writeUint32(trailer, adler);
+    stream.insert(stream.end(), trailer, trailer + 4);
+
+    writeHeader(out, width, height, channels);
+    writeIdat(out, stream);
+    writeEnd(out);
+}
+
+PngEncoder::PngEncoder(ostream &out, unsigned width, unsigned height,
+                       unsigned channels, PngCompression compression)
+:
+    d_out(out),
+    d_stride(size_t(width) * channels),
+    d_channels(channels),
+    d_height(height),
+    d_level(Png::level(compression)),
+    d_blockRows(blockRows(d_stride)),
+    d_adler(adler32(0, nullptr, 0))
+{
+    // a few blocks per thread, so uneven blocks still balance
+    unsigned threads = max(1u, thread::hardware_concurrency());
+    d_batchRows = d_blockRows * 4 * threads;
+    d_rows.resize((min(d_batchRows, max(height, 1u)) + 1) * d_stride);
+
+    Png::writeHeader(out, width, height, channels);
+}
+
+void PngEncoder::write_row(unsigned char const *row)
+{
+    if (d_done + d_buffered == d_height)
+        throw runtime_error("PngEncoder: more rows than the image has");
+
+    copy(row, row + d_stride, &d_rows[(1 + d_buffered) * d_stride]);
+    ++d_buffered;
+    if (d_done + d_buffered == d_height || d_buffered == d_batchRows)
+        flush();
+}
+
+void PngEncoder::finish()
+{
+    if (d_done != d_height)
+        throw runtime_error("PngEncoder: image is incomplete");
+
+    if (d_height == 0)              // no rows: an empty final block
+    {
+        vector<unsigned char> stream;
+        zlibHeader(stream, d_level);
+        stream.push_back(0x03);
+        stream.push_back(0x00);
+        unsigned char trailer[4];
+        writeUint32(trailer, d_adler);
+        stream.insert(stream.end(), trailer, trailer + 4);
+        writeIdat(d_out, stream);
+    }
+    Png::writeEnd(d_out);
+}
+
+void PngEncoder::flush()
+{
+    // Blocks start at multiples of d_blockRows from the top, as in encode
+    vector<Block> blocks;
+    for (unsigned row = 0; row < d_buffered; row += d_blockRows)
+        blocks.push_back(Block{ row, min(d_blockRows, d_buffered - row),
+                                {}, {}, 0 });
+    bool last = d_done + d_buffered == d_height;
+
+    // d_rows starts with the last row of the previous batch
+    unsigned char const *rows = d_rows.data() + d_stride;
+    parallelFor(blocks.size(), [&](unsigned idx)
+    {
+        unsigned char const *first = rows + blocks[idx].firstRow * d_stride;
+        filterBlock(blocks[idx], first,
+                    d_done + blocks[idx].firstRow == 0 ? nullptr : first - d_stride,
+                    d_stride, d_channels);
+    });
+    parallelFor(blocks.size(), [&](unsigned idx)
+    {
+        deflateBlock(blocks[idx],
+                     idx != 0 ? tail(blocks[idx - 1])
+                              : Dictionary(d_tail.data(), d_tail.size()),
+                     last && idx + 1 == blocks.size(), d_level);
+    });
+
+    vector<unsigned char> stream;
+    if (d_done == 0)
+        zlibHeader(stream, d_level);
+    for (Block const &block : blocks)
+    {
+        stream.insert(stream.end(), block.compressed.begin(),
+                      block.compressed.end());
+        d_adler = adler32_combine(d_adler, block.adler, block.filtered.size());
+    }
+    if (last)
+    {
+        unsigned char trailer[4];
+        writeUint32(trailer, d_adler);
+        stream.insert(stream.end(), trailer, trailer + 4);
+    }
+    writeIdat(d_out, stream);
+
+    auto dict = tail(blocks.back());
+    d_tail.assign(dict.first, dict.first + dict.second);
+    copy(&d_rows[d_buffered * d_stride], &d_rows[(d_buffered + 1) * d_stride],
+         d_rows.begin());
+    d_done += d_buffered;
+    d_buffered = 0;
+}
+
+PngCompression Png::parseCompression(string const &name)
+{
+    if (name == "fast")
+        return PngCompression::Fast;
+    if (name == "default")
+        return PngCompression::Default;
+    if (name == "best")
+        return PngCompression::Best;
+    throw runtime_error("Unknown PNG compression preset: " + name);
+}
+
+int Png::level(PngCompression compression)
+{
+    switch (compression)
+    {
+        case PngCompression::Fast: return 1;
+        case PngCompression::Best: return 9;
+        default:                   return 6;
+    }
+}
+
+void Png::writeHeader(ostream &out, unsigned width, unsigned height,
+                      unsigned channels)
+{
+    static unsigned char const signature[] =
+        { 137, 80, 78, 71, 13, 10, 26, 10 };
+    out.write(reinterpret_cast<char const *>(signature), sizeof(signature));
+
+    unsigned char ihdr[13];
+    writeUint32(ihdr, width);
+    writeUint32(ihdr + 4, height);
+    ihdr[8] = 8;                            // bit depth
+    ihdr[9] = channels == 4 ? 6 : 2;        // RGBA or RGB
+    ihdr[10] = 0;                           // deflate
+    ihdr[11] = 0;                           // adaptive filtering
+    ihdr[12] = 0;                           // no interlace
+    writeChunk(out, "IHDR", ihdr, sizeof(ihdr));
+}
+
+void Png::writeChunk(ostream &out, char const type[4],
+                     unsigned char const *data, size_t size)
+{
+    // The CRC covers type and data
+    vector<unsigned char> chunk(12 + size);
+    writeUint32(&chunk[0], size);
+    copy(type, type + 4, chunk.begin() + 4);
+    copy(data, data + size, chunk.begin() + 8);
+    writeUint32(&chunk[8 + size], lodepng_crc32(&chunk[4], size + 4));
+    out.write(reinterpret_cast<char const *>(chunk.data()), chunk.size());
+}
+
+void Png::writeEnd(ostream &out)
+{
+    writeChunk(out, "IEND", nullptr, 0);
+}
+
+void Png::filterRow(unsigned char *out, unsigned char const *row,
+                    unsigned char const *prev, size_t size, unsigned bpp)
+{
+    // Pick the filter on the sums alone, then filter once
+    unsigned best = 0;
+    size_t bestSum = 0;
+    for (unsigned type = 0; type != 5; ++type)
+    {
+        size_t sum = filters[type](nullptr, row, prev, size, bpp);
+        if (type == 0 || sum < bestSum)
+        {
+            best = type;
+            bestSum = sum;
+        }
+    }
+    out[0] = best;
+    filters[best](out + 1, row, prev, size, bpp);
+}
@@ -0,0 +1,98 @@
+#ifndef PNG_H_
+#define PNG_H_
+
+#include "triple.h"
+
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// Compression presets for the PNG encoders, trading file size for speed
+enum class PngCompression
+{
+    Fast,       // zlib level 1
+    Default,    // zlib level 6
+    Best        // zlib level 9
+};
+
+// Writing 8 bit RGB(A) PNG files: a parallel encoder for whole images and
+// the helpers shared with the streaming encoder (see imagestream.h)
+class Png
+{
+    public:
+        // Encode a complete image of width x height pixels with channels
+        // (3 or 4) bytes each. Blocks of rows are filtered and deflated on
+        // all threads and joined into a single zlib stream (as pigz does).
+        static void encode(std::ostream &out, unsigned char const *pixels,
+                           unsigned width, unsigned height, unsigned channels,
+                           PngCompression compression);
+
+        // "fast", "default" or "best", throws on anything else
+        static PngCompression parseCompression(std::string const &name);
+
+        // zlib level of a preset
+        static int level(PngCompression compression);
+
+        // Signature and IHDR chunk, channels is 3 (RGB) or 4 (RGBA)
+        static void writeHeader(std::ostream &out, unsigned width,
+                                unsigned height, unsigned channels);
+
+        // A complete chunk: length, type, data and CRC
+        static void writeChunk(std::ostream &out, char const type[4],
+                               unsigned char const *data, size_t size);
+
+        // IEND chunk
+        static void writeEnd(std::ostream &out);
+
+        // Filter one scanline of size bytes, bpp bytes per pixel. prev is
+        // the previous unfiltered scanline or nullptr for the first one.
+        // out receives the filter type followed by size filtered bytes; the
+        // filter with the smallest sum of residues is used (as lodepng).
+        static void filterRow(unsigned char *out, unsigned char const *row,
+                              unsigned char const *prev, size_t size,
+                              unsigned bpp);
+
+        // color channel [0, 1] -> byte, same conversion as Image::write_png
+        static unsigned char toByte(Real value)
+        {
+            return static_cast<unsigned char>(value * 255.0);
+        }
+};
+
+// The block encoder of Png::encode fed a row at a time: rows are buffered
+// until a batch of blocks (a few per thread) is full, then the batch is
+// filtered and deflated on all threads and written out as IDAT chunks. The
+// output is the same as Png::encode's for the same image, memory stays at a
+// batch.
+class PngEncoder
+{
+    std::ostream &d_out;
+    size_t d_stride;
+    unsigned d_channels;
+    unsigned d_height;
+    int d_level;
+    unsigned d_blockRows;
+    unsigned d_batchRows;
+    std::vector<unsigned char> d_rows;  // the previous row, then the batch
+    unsigned d_buffered = 0;            // rows in the batch
+    unsigned d_done = 0;                // rows written before it
+    std::vector<unsigned char> d_tail;  // dictionary for the next block
+    unsigned d_adler;
+
+    public:
+        // Writes the signature and IHDR chunk
+        PngEncoder(std::ostream &out, unsigned width, unsigned height,
+                   unsigned channels, PngCompression compression);
+
+        // The next row, width * channels bytes
+        void write_row(unsigned char const *row);
+
+        // Write the IEND chunk, throws if rows are missing
+        void finish();
+
+    private:
+        void flush();
+};
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef PRECISION_H_
+#define PRECISION_H_
+
+#include <cfloat>   // DBL_EPSILON, FLT_EPSILON
+
+// Scalar type of the whole trace pipeline (Triple, Ray, Hit, Material, ...)
+// Configure with -DRAY_SINGLE_PRECISION=ON to trace in float instead of
+// double, which halves the size of every Triple.
+#ifdef RAY_SINGLE_PRECISION
+typedef float Real;
+#else
+typedef double Real;
+#endif
+
+// Tolerances that depend on the scalar type
+template <typename T>
+struct Precision;
+
+template <>
+struct Precision<double>
+{
+    // machine epsilon, used for the determinant and t checks
+    static constexpr double epsilon() { return DBL_EPSILON; }
+    // offset of secondary ray origins along the normal (self intersection)
+    static constexpr double bias() { return 1e-5; }
+    // below this |cos| a ray counts as parallel to a plane
+    static constexpr double parallel() { return 1e-9; }
+};
+
+// Float renders are close to double ones, not identical: isolated shadow
+// and reflection rays turn out differently, and rays through a shared mesh
+// edge (the cube's edges in scene02) hit or miss by rounding. The bias is
+// the best of 1e-1 .. 1e-3 on the shipped scenes, smaller gives acne.
+template <>
+struct Precision<float>
+{
+    static constexpr float epsilon() { return FLT_EPSILON; }
+    static constexpr float bias() { return 1e-2f; }
+    static constexpr float parallel() { return 1e-6f; }
+};
+
+#endif
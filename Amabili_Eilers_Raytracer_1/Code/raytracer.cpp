@@ -1,6 +1,15 @@
 #include "raytracer.h"
 
+#include "checkpoint.h"
+#include "contributions.h"
+#include "costmap.h"
+#include "denoise.h"
+#include "hash.h"
 #include "image.h"
+#include "jsonstream.h"
+#include "texture.h"
+#include "watch.h"
+#include "imagestream.h"
 #include "light.h"
 #include "material.h"
 #include "triple.h"
@@ -23,15 +32,44 @@
 
 #include <utility> // declval, forward, move, pair, swap
 
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <exception>
 #include <fstream>
 #include <iostream>
+#include <limits>
+#include <thread>
+#include <vector>
 
 
 
 using namespace std;        // no std:: required
 using json = nlohmann::json;
 
+// Larger images are always streamed, a full Image would not fit in memory
+static size_t const STREAMING_PIXELS = 4096 * 4096;
+
+namespace
+{
+    // Fold an asset file's path, modification time and size into hash, so
+    // a checkpoint stops matching when a mesh or texture changes
+    uint64_t hashAsset(uint64_t hash, string const &filename)
+    {
+        for (unsigned char ch : filename)
+            hash = fnv1a(hash, ch);
+        hash = fnv1a(hash, 0);
+        pair<int64_t, int64_t> version = fileVersion(filename);
+        for (int64_t value : {version.first, version.second})
+            for (unsigned idx = 0; idx != 8; ++idx)
+                hash = fnv1a(hash, uint64_t(value) >> 8 * idx & 0xff);
+        return hash;
+    }
+}
+
 bool Raytracer::parseObjectNode(json const &node)
 {
     ObjectPtr obj = nullptr;
@@ -40,32 +78,41 @@ bool Raytracer::parseObjectNode(json const &node)
 // -- Determine type and parse object parametrers ------------------------------
 // =============================================================================
 
-    if (node["type"] == "sphere")
+    // compare the type as a plain string, json == "..." builds a json
+    // value for every comparison
+    json const &typeNode = node["type"];
+    string type = typeNode.is_string() ? typeNode.get<string>() : "";
+
+    if (type == "sphere")
     {
         Point pos(node["position"]);
-        double radius = node["radius"];
-        obj = ObjectPtr(new Sphere(pos, radius));
+        Real radius = node["radius"];
+        // optional texture orientation: north pole and angle around it
+        Vector pole = node.count("rotation") ? Vector(node["rotation"])
+                                             : Vector(0.0, 1.0, 0.0);
+        Real angle = node.count("angle") ? node["angle"].get<Real>() : 0.0;
+        obj = scene.createObject<Sphere>(pos, radius, pole, angle);
     }
-    else if (node["type"] == "plane") 
+    else if (type == "plane")
     {
         Point pos(node["position"]);
         Point normal(node["normal"]);
-        obj = ObjectPtr(new Plane(pos, normal));
+        obj = scene.createObject<Plane>(pos, normal);
     }
-    else if (node["type"] == "triangle")
+    else if (type == "triangle")
     {
         Point v1(node["point1"]);
         Point v2(node["point2"]);
         Point v3(node["point3"]);
-        obj = ObjectPtr(new Triangle(v1, v2, v3));
+        obj = scene.createObject<Triangle>(v1, v2, v3);
     }
-    else if (node["type"] == "mesh") 
+    else if (type == "mesh")
     {   
         return initializeMesh(node);
     }
     else
     {
-        cerr << "Unknown object type: " << node["type"] << ".\n";
+        cerr << "Unknown object type: " << typeNode << ".\n";
     }
 
 // =============================================================================
@@ -88,24 +135,76 @@ Light Raytracer::parseLightNode(json const &node) const
     return Light(pos, col);
 }
 
-Material Raytracer::parseMaterialNode(json const &node) const
+Material Raytracer::parseMaterialNode(json const &node)
 {
-    Color color(node["color"]);
-    double ka = node["ka"];
-    double kd = node["kd"];
-    double ks = node["ks"];
-    double n  = node["n"];
-    return Material(color, ka, kd, ks, n);
+    // a texture replaces the color, its path is relative to the scene file
+    bool textured = node.count("texture") != 0;
+    Color color = textured && !node.count("color") ? Color(1.0, 1.0, 1.0)
+                                                   : Color(node["color"]);
+    Real ka = node["ka"];
+    Real kd = node["kd"];
+    Real ks = node["ks"];
+    Real n  = node["n"];
+    Material material(color, ka, kd, ks, n);
+    if (textured)
+    {
+        string name = node["texture"].get<string>();
+        if (name.empty() || name[0] != '/')
+            name = sceneDirectory + name;
+        material.texture = TextureCache::instance().get(name);
+        assets.push_back(name);
+    }
+    return material;
 }
 
 bool Raytracer::readScene(string const &ifname)
+{
+    ifstream infile(ifname, ios::binary);   // text or binary scenes
+    if (!infile)
+    {
+        cerr << "Could not open input file for reading.\n";
+        return false;
+    }
+    size_t slash = ifname.find_last_of('/');
+    return readScene(infile, slash == string::npos ? "" : ifname.substr(0, slash + 1));
+}
+
+bool Raytracer::readScene(istream &infile, string const &directory)
 try
 {
-    // Read and parse input json file
-    ifstream infile(ifname);
-    if (!infile) throw runtime_error("Could not open input file for reading.");
-    json jsonscene;
-    infile >> jsonscene;
+    sceneDirectory = directory;
+    assets.clear();
+
+    // Stream the input json: objects and lights are built as their
+    // elements are parsed, only the small settings members are kept
+    auto start = chrono::steady_clock::now();
+    json jsonscene = json::object();
+    unsigned objCount = 0;
+
+    JsonStreamReader reader(infile);
+    reader.read({"Objects", "Lights"},
+        [&](string const &key, json const &value)
+        {
+            jsonscene[key] = value;
+        },
+        [&](string const &key, json const &element)
+        {
+            if (key == "Lights")
+            {
+                lights.push_back(parseLightNode(element));
+                scene.addLight(lights.back());
+                return;
+            }
+            unsigned first = scene.getNumObject();
+            if (parseObjectNode(element))
+                ++objCount;
+            objectRanges.push_back({first, scene.getNumObject() - first});
+        });
+    sceneHash = reader.hash();
+    sort(assets.begin(), assets.end());     // objects share textures
+    assets.erase(unique(assets.begin(), assets.end()), assets.end());
+    for (string const &asset : assets)
+        sceneHash = hashAsset(sceneHash, asset);
 
 // =============================================================================
 // -- Read your scene data in this section -------------------------------------
@@ -134,22 +233,117 @@ try
     j = jsonscene["SuperSamplingFactor"];
     int superSamplingFactor = 1;
     if(j.is_number()) {
-        superSamplingFactor = j.get<int>();
+        //values that do not fit an int become 0, which is rejected
+        bool fits = j.get<double>() < numeric_limits<int>::max();
+        superSamplingFactor = fits ? j.get<int>() : 0;
     }
     scene.setSuperSamplingFactor(superSamplingFactor);
     
+    //Get the pixel traversal order and its tile size
+    j = jsonscene["Traversal"];
+    Traversal traversal = Traversal::RowMajor;
+    if(j.is_string()) {
+        traversal = parseTraversal(j.get<string>());
+    }
+    j = jsonscene["TileSize"];
+    unsigned tileSize = 16;
+    if(j.is_number()) {
+        //anything that would not fit becomes 0, which setTraversal rejects
+        bool fits = j.is_number_unsigned()
+            && j.get<uint64_t>() <= Scene::MAX_TILE_SIZE;
+        tileSize = fits ? j.get<unsigned>() : 0;
+    }
+    scene.setTraversal(traversal, tileSize);
+    
+    //Get the output resolution and whether to stream it to the file
+    j = jsonscene["Size"];
+    if(j.is_array()) {
+        width = j[0].get<unsigned>();
+        height = j[1].get<unsigned>();
+    }
+    j = jsonscene["Streaming"];
+    if(j.is_boolean()) {
+        streaming = j.get<bool>();
+    }
+    
+    //Get the PNG compression preset (speed versus size)
+    j = jsonscene["Compression"];
+    if(j.is_string()) {
+        compression = Png::parseCompression(j.get<string>());
+    }
+    
+    //Get the storage format of the framebuffer
+    j = jsonscene["Framebuffer"];
+    if(j.is_string()) {
+        framebuffer = parsePixelFormat(j.get<string>());
+    }
+    
+    //Get the number of seconds between checkpoints
+    j = jsonscene["Checkpoint"];
+    if(j.is_number_unsigned()) {
+        checkpointInterval = j.get<unsigned>();
+    }
+    
+    //Denoising: true for the default number of passes, or a pass count
+    j = jsonscene["Denoise"];
+    if(j.is_boolean()) {
+        denoiseIterations = j.get<bool>() ? DenoiseSettings().iterations : 0;
+    }
+    else if(j.is_number_unsigned()) {
+        denoiseIterations = j.get<unsigned>();
+    }
+    
+    //Write the first hit normal, depth and albedo next to the image
+    j = jsonscene["AuxBuffers"];
+    if(j.is_boolean()) {
+        auxBuffers = j.get<bool>();
+    }
+    
+    //Memory for decoded texture tiles, in MiB (see getTextureBudget)
+    j = jsonscene["TextureBudget"];
+    if(j.is_number_unsigned()) {
+        textureBudget = j.get<size_t>() << 20;
+    }
+    
+    //Skip lights that add little: true for the defaults, or an object
+    //with a "threshold", a number of "shadowSamples" and "horizon"
+    j = jsonscene["LightCulling"];
+    if(j.is_boolean() && j.get<bool>()) {
+        scene.setLightCulling(LightCulling());
+    }
+    else if(j.is_object()) {
+        LightCulling culling;
+        if(j["threshold"].is_number()) {
+            culling.threshold = j["threshold"].get<Real>();
+        }
+        if(j["shadowSamples"].is_number_unsigned()) {
+            culling.shadowSamples = j["shadowSamples"].get<unsigned>();
+        }
+        if(j["horizon"].is_boolean()) {
+            culling.horizon = j["horizon"].get<bool>();
+        }
+        scene.setLightCulling(culling);
+    }
+    
+    //Write heatmaps and a float buffer of what each pixel cost
+    j = jsonscene["CostMap"];
+    if(j.is_boolean()) {
+        costMap = j.get<bool>();
+    }
+    
+    
+    //Keyframes for rendering a range of frames (see animation.h)
+    j = jsonscene["Animation"];
+    if(j.is_object()) {
+        animation = Animation(j, lights.size(), objectRanges.size());
+    }
     
     // TODO: add your other configuration settings here
 
-    for (auto const &lightNode : jsonscene["Lights"])
-        scene.addLight(parseLightNode(lightNode));
-
-    unsigned objCount = 0;
-    for (auto const &objectNode : jsonscene["Objects"])
-        if (parseObjectNode(objectNode))
-            ++objCount;
-
-    cout << "Parsed " << objCount << " objects.\n";
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    double megabytes = reader.bytesRead() / 1e6;
+    out() << "Parsed " << objCount << " objects (" << megabytes << " MB at "
+           << megabytes / elapsed.count() << " MB/s).\n";
 
 // =============================================================================
 // -- End of scene data reading ------------------------------------------------
@@ -163,15 +357,756 @@ catch (exception const &ex)
     return false;
 }
 
-void Raytracer::renderToFile(string const &ofname)
+void Raytracer::applyOverrides(json const &node)
+{
+    if (node.count("Eye"))
+        scene.setEye(Point(node["Eye"]));
+
+    if (node.count("Lights"))
+    {
+        lights.clear();
+        scene.clearLights();
+        for (auto const &lightNode : node["Lights"])
+        {
+            lights.push_back(parseLightNode(lightNode));
+            scene.addLight(lights.back());
+        }
+    }
+
+    if (node.count("Size"))
+    {
+        json const &size = node["Size"];
+        if (!size.is_array() || size.size() != 2)
+            throw runtime_error("Size must be [width, height]");
+        width = size[0].get<unsigned>();
+        height = size[1].get<unsigned>();
+    }
+}
+
+void Raytracer::renderToFile(string const &ofname, bool resume)
+{
+    bool ppm = ofname.size() >= 4
+        && ofname.compare(ofname.size() - 4, 4, ".ppm") == 0;
+    if (streaming || ppm || size_t(width) * height > STREAMING_PIXELS)
+    {
+        if (resume)
+            out() << "Streamed renders keep no checkpoint, starting over.\n";
+        if (denoiseIterations || auxBuffers)
+            out() << "Streamed renders are not denoised.\n";
+        if (costMap)
+            out() << "Streamed renders keep no cost map.\n";
+        renderStreaming(ofname);
+        return;
+    }
+
+    // the denoiser filters full precision colors, they are stored in the
+    // framebuffer format after it ran
+    Image img(width, height, denoiseIterations ? PixelFormat::Float : framebuffer);
+    Checkpoint checkpoint(ofname + ".ckpt", img, scene.getTileSize(), sceneHash);
+    if (resume)
+    {
+        if (checkpoint.load())
+            out() << "Resuming with " << checkpoint.doneCount() << " of "
+                   << checkpoint.bands() << " bands done.\n";
+        else
+            out() << "No matching checkpoint, starting over.\n";
+    }
+
+    // Resumed bands keep a zero cost
+    CostMap costs(costMap ? width : 0, costMap ? height : 0);
+    if (costMap)
+        scene.setCostMap(&costs);
+
+    ShadowStats shadowsBefore = scene.getShadowStats();
+
+    out() << "Tracing...\n";
+    auto start = chrono::steady_clock::now();
+    auto saved = start;
+
+    // Render a band of tiles at a time into a Float buffer and store it
+    // at its place in img, which quantizes exactly like a render of the
+    // whole image at once would
+    unsigned bandHeight = checkpoint.bandHeight();
+    Image band(width, bandHeight);
+    for (unsigned idx = 0; idx != checkpoint.bands(); ++idx)
+    {
+        if (checkpoint.done(idx))
+            continue;
+
+        unsigned y0 = idx * bandHeight;
+        if (height - y0 < bandHeight)
+            band = Image(width, height - y0);
+
+        scene.render(band, 0, y0, height);
+        for (unsigned y = 0; y != band.height(); ++y)
+            for (unsigned x = 0; x != width; ++x)
+                img.store(x, y0 + y, band.load(x, y));
+        checkpoint.markDone(idx);
+
+        auto now = chrono::steady_clock::now();
+        if (checkpointInterval != 0 && idx + 1 != checkpoint.bands()
+            && now - saved >= chrono::seconds(checkpointInterval))
+        {
+            checkpoint.save();
+            saved = now;
+        }
+    }
+
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    out() << "Traced in " << elapsed.count() << " s.\n";
+
+    ShadowStats shadows = scene.getShadowStats();
+    uint64_t occluded = shadows.occluded - shadowsBefore.occluded;
+    if (occluded != 0)
+        out() << "Shadow rays: " << shadows.rays - shadowsBefore.rays << ", "
+               << occluded << " occluded, "
+               << 100.0 * (shadows.cacheHits - shadowsBefore.cacheHits) / occluded
+               << "% of those by the light's last occluder.\n";
+
+    TextureStats stats = TextureCache::instance().stats();
+    if (stats.hits + stats.misses != 0)
+        out() << "Texture cache: " << stats.hits << " hits, " << stats.misses
+               << " misses, " << stats.decodes << " decodes, " << stats.evictions
+               << " evictions, " << (stats.residentBytes >> 10) << " of "
+               << (stats.budgetBytes >> 10) << " KiB resident.\n";
+
+    string stem = ofname.substr(0, ofname.find_last_of('.'));
+    if (costMap)
+    {
+        scene.setCostMap(nullptr);
+        CostTotal total = costs.total();
+        out() << "Cost: " << total.rays << " rays, " << total.tests
+               << " intersection tests, written to " << stem << "-cost-*.png and "
+               << stem << "-cost.pfm\n";
+        costs.write_heatmaps(stem + "-cost");
+        costs.write_pfm(stem + "-cost.pfm");
+    }
+
+    if (denoiseIterations || auxBuffers)
+    {
+        start = chrono::steady_clock::now();
+        AuxBuffers aux(width, height);
+        scene.renderAux(aux);
+        if (auxBuffers)
+            aux.write_png(stem);
+
+        if (denoiseIterations)
+        {
+            DenoiseSettings settings;
+            settings.iterations = denoiseIterations;
+            denoise(img, aux, settings);
+
+            // whole frame stores, so the dither lines up as without
+            // denoising
+            if (framebuffer != PixelFormat::Float)
+            {
+                Image stored(width, height, framebuffer);
+                for (unsigned y = 0; y != height; ++y)
+                    for (unsigned x = 0; x != width; ++x)
+                        stored.store(x, y, img.load(x, y));
+                img = move(stored);
+            }
+        }
+        elapsed = chrono::steady_clock::now() - start;
+        out() << (denoiseIterations ? "Denoised" : "Rendered aux buffers")
+               << " in " << elapsed.count() << " s.\n";
+    }
+
+    out() << "Writing image to " << ofname << "...\n";
+    img.write_png(ofname, compression);
+    checkpoint.remove();
+    out() << "Done.\n";
+}
+
+void Raytracer::watch(string const &ifname, string const &ofname)
+{
+    auto version = fileVersion(ifname);
+    SceneDigest digest = digestScene(ifname);
+
+    Image img;
+    ContributionMap contributions(0, 0);
+    bool full = true;
+    vector<bool> dirty;
+    while (true)
+    {
+        auto start = chrono::steady_clock::now();
+        size_t traced = size_t(width) * height;
+        scene.setContributions(&contributions);
+        if (full)
+        {
+            img = Image(width, height, framebuffer);
+            contributions = ContributionMap(width, height);
+            scene.render(img);
+        }
+        else
+        {
+            vector<PixelOffset> pixels;
+            for (unsigned y = 0; y != height; ++y)
+                for (unsigned x = 0; x != width; ++x)
+                    if (contributions.touches(x, y, dirty))
+                        pixels.push_back(PixelOffset{x, y});
+            traced = pixels.size();
+            scene.render(img, pixels);
+        }
+        scene.setContributions(nullptr);
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        out() << "Traced " << traced << " pixels in " << elapsed.count() << " s.\n";
+
+        if (traced != 0)
+            img.write_png(ofname, compression);
+        out() << "Watching " << ifname << " for changes...\n";
+        out().flush();
+
+        // Wait for a version that parses
+        while (true)
+        {
+            this_thread::sleep_for(chrono::milliseconds(200));
+            auto current = fileVersion(ifname);
+            if (current == version)
+                continue;
+            version = current;
+
+            Raytracer updated;
+            SceneDigest next;
+            try
+            {
+                next = digestScene(ifname);
+            }
+            catch (exception const &ex)
+            {
+                cerr << ex.what() << '\n';
+                continue;
+            }
+            if (!updated.readScene(ifname))
+                continue;
+
+            // Same settings, lights and shapes: only the pixels of
+            // objects with a new material change
+            full = next.settings != digest.settings
+                || next.lights != digest.lights || next.shapes != digest.shapes;
+            dirty.assign(updated.scene.getNumObject(), false);
+            for (size_t idx = 0; !full && idx != next.materials.size(); ++idx)
+            {
+                if (next.materials[idx] == digest.materials[idx])
+                    continue;
+                ObjectRange const &range = updated.objectRanges[idx];
+                fill(dirty.begin() + range.first,
+                     dirty.begin() + range.first + range.count, true);
+            }
+
+            out() << (full ? "Scene changed, tracing it all again.\n"
+                            : "Materials changed, tracing their pixels again.\n");
+            digest = next;
+            *this = move(updated);
+            if (textureBudget != 0)
+                TextureCache::instance().setBudget(textureBudget);
+            break;
+        }
+    }
+}
+
+void Raytracer::renderProgressive(string const &ofname)
+{
+    string preview = ofname.substr(0, ofname.find_last_of('.')) + "-preview.png";
+
+    // Samples at full resolution pixel centres, level s traces every s-th
+    // pixel of every s-th row that no coarser level traced yet
+    Image samples(width, height);
+    vector<bool> done(size_t(width) * height, false);
+    auto trace = [&](Scene &scn, unsigned step, bool keep)
+    {
+        auto start = chrono::steady_clock::now();
+        vector<PixelOffset> pixels;
+        for (unsigned y = 0; y < height; y += step)
+            for (unsigned x = 0; x < width; x += step)
+                if (!done[size_t(y) * width + x])
+                    pixels.push_back(PixelOffset{x, y});
+        scn.render(samples, pixels);
+        if (keep)
+            for (PixelOffset const &p : pixels)
+                done[size_t(p.y) * width + p.x] = true;
+        if (step == 1)
+            return;
+
+        Image img((width + step - 1) / step, (height + step - 1) / step);
+        for (unsigned y = 0; y < height; y += step)
+            for (unsigned x = 0; x < width; x += step)
+                img.store(x / step, y / step, samples.load(x, y));
+        img.write_png(preview, PngCompression::Fast);
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        out() << "Preview 1/" << step << " (" << img.width() << 'x'
+               << img.height() << ") in " << elapsed.count() * 1000 << " ms.\n";
+        out().flush();
+    };
+
+    Scene quick(scene);
+    quick.setShadows(false);
+    quick.setMaxRecursionDepth(0);
+    quick.setSuperSamplingFactor(1);
+    trace(quick, 8, false);
+
+    Scene refine(scene);
+    refine.setSuperSamplingFactor(1);
+    trace(refine, 4, true);
+    trace(refine, 2, true);
+
+    // Supersampled pixels are not made of these samples, and the other
+    // outputs need the whole renderToFile: the final pass starts over
+    bool ppm = ofname.size() >= 4
+        && ofname.compare(ofname.size() - 4, 4, ".ppm") == 0;
+    bool reuse = scene.getSuperSamplingFactor() == 1 && !streaming && !ppm
+        && !denoiseIterations && !auxBuffers && !costMap
+        && size_t(width) * height <= STREAMING_PIXELS;
+    if (!reuse)
+    {
+        renderToFile(ofname);
+        return;
+    }
+
+    out() << "Tracing...\n";
+    auto start = chrono::steady_clock::now();
+    trace(scene, 1, true);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    out() << "Traced in " << elapsed.count() << " s.\n";
+
+    // store quantizes like renderToFile does
+    Image img(width, height, framebuffer);
+    for (unsigned y = 0; y != height; ++y)
+        for (unsigned x = 0; x != width; ++x)
+            img.store(x, y, samples.load(x, y));
+    out() << "Writing image to " << ofname << "...\n";
+    img.write_png(ofname, compression);
+    out() << "Done.\n";
+}
+
+namespace
+{
+    // Settings renderDeadline may trace a tile with, best first
+    struct Quality
+    {
+        int superSampling;
+        int depth;
+    };
+
+    vector<Quality> qualityLadder(int superSampling, int depth)
+    {
+        vector<Quality> ladder;
+        for (int ss = max(superSampling, 1); ss >= 1; --ss)
+            ladder.push_back(Quality{ss, depth});
+        for (int d = depth - 1; d >= 0; --d)
+            ladder.push_back(Quality{1, d});
+        return ladder;
+    }
+
+    // Luminance spread of some samples, how much a tile gains from
+    // more samples per pixel
+    Real spread(vector<Color> const &colors)
+    {
+        Real lo = numeric_limits<Real>::infinity();
+        Real hi = -lo;
+        for (Color const &c : colors)
+        {
+            Real y = 0.2126 * c.r + 0.7152 * c.g + 0.0722 * c.b;
+            lo = min(lo, y);
+            hi = max(hi, y);
+        }
+        return colors.empty() ? 0 : hi - lo;
+    }
+}
+
+void Raytracer::renderDeadline(string const &ofname, double seconds)
+{
+    typedef chrono::steady_clock Clock;
+    auto start = Clock::now();
+    auto deadline = start + chrono::duration_cast<Clock::duration>(
+        chrono::duration<double>(seconds));
+    auto left = [&]()
+    {
+        return chrono::duration<double>(deadline - Clock::now()).count();
+    };
+
+    // the first pass traces every 8th pixel, at least one per tile
+    unsigned tileSize = scene.getTileSize();
+    unsigned const PROBE = min(8u, tileSize);
+    int superSampling = scene.getSuperSamplingFactor();
+    int depth = scene.getMaxRecursionDepth();
+
+    struct Tile
+    {
+        unsigned x0, y0, x1, y1;
+        double cost;                    // first pass seconds per pixel
+        Real detail;
+    };
+    vector<Tile> tiles;
+    for (unsigned y = 0; y < height; y += tileSize)
+        for (unsigned x = 0; x < width; x += tileSize)
+            tiles.push_back(Tile{x, y, min(x + tileSize, width),
+                                 min(y + tileSize, height), 0.0, 0.0});
+
+    // First pass: one sample per probed pixel with all effects, traced
+    // once. The cost map times every probe, scaled to what the pass took
+    // as a whole that gives what a pixel of each tile costs.
+    Image probe(width, height);
+    Scene measure(scene);
+    measure.setSuperSamplingFactor(1);
+    CostMap probeCosts(width, height);
+    measure.setCostMap(&probeCosts);
+    vector<PixelOffset> probes;
+    for (unsigned y = 0; y < height; y += PROBE)
+        for (unsigned x = 0; x < width; x += PROBE)
+            probes.push_back(PixelOffset{x, y});
+    uint64_t raysBefore = measure.getRayCount();
+    auto passStart = Clock::now();
+    measure.render(probe, probes);
+    double full = chrono::duration<double>(Clock::now() - passStart).count();
+    double rays = double(measure.getRayCount() - raysBefore) / probes.size();
+
+    double probeTime = 0;               // seconds, as the cost map has it
+    for (Tile &tile : tiles)
+    {
+        vector<Color> colors;
+        // the probes are on a grid of their own, not aligned with tiles
+        auto first = [&](unsigned from) { return (from + PROBE - 1) / PROBE * PROBE; };
+        for (unsigned y = first(tile.y0); y < tile.y1; y += PROBE)
+            for (unsigned x = first(tile.x0); x < tile.x1; x += PROBE)
+            {
+                colors.push_back(probe.load(x, y));
+                tile.cost += probeCosts.at(x, y).nanoseconds * 1e-9;
+            }
+        probeTime += tile.cost;
+        tile.cost /= max<size_t>(colors.size(), 1);
+        tile.detail = spread(colors);
+    }
+    for (Tile &tile : tiles)
+        tile.cost *= probeTime > 0 ? full / probeTime : 0;
+
+    // Cost of a pixel at quality q relative to the first pass. Without
+    // reflections a pixel traces its primary ray and a shadow ray per
+    // light, the rays above that are what depth adds.
+    double direct = min(rays,
+        1.0 + (scene.getShadows() ? scene.getNumLights() : 0));
+    auto factor = [&](Quality q)
+    {
+        double reflect = depth == 0 || rays == 0 ? 1.0
+            : (direct + (rays - direct) * q.depth / depth) / rays;
+        return q.superSampling * q.superSampling * reflect;
+    };
+
+    // Detailed tiles first, they lose the most when they get a lower
+    // quality at the end
+    stable_sort(tiles.begin(), tiles.end(),
+        [](Tile const &a, Tile const &b) { return a.detail > b.detail; });
+
+    double estimate = 0;                // first pass estimate of all tiles
+    for (Tile const &tile : tiles)
+        estimate += tile.cost * (tile.x1 - tile.x0) * (tile.y1 - tile.y0);
+
+    vector<Quality> ladder = qualityLadder(superSampling, depth);
+    size_t level = 0;
+    double traced = 0;                  // estimate of the tiles done
+    double spent = 0;                   // and what they took
+    auto fits = [&](size_t lvl)
+    {
+        // 10% margin, scaled by how the estimates held up so far
+        double scale = traced > 0 ? spent / traced : 1.0;
+        return (estimate - traced) * factor(ladder[lvl]) * scale < 0.9 * left();
+    };
+    while (level + 1 < ladder.size() && !fits(level))
+        ++level;
+    double firstPass = chrono::duration<double>(Clock::now() - start).count();
+    out() << "First pass of " << probes.size() << " pixels in " << firstPass
+           << " s (" << 100.0 * firstPass / seconds
+           << "% of the budget), starting at supersampling "
+           << ladder[level].superSampling << ", depth " << ladder[level].depth
+           << ".\n";
+
+    // Settings renderToFile honours that do not fit a budget
+    if (denoiseIterations || auxBuffers)
+        out() << "Deadline renders are not denoised.\n";
+    if (streaming)
+        out() << "Deadline renders keep the whole image in memory.\n";
+
+    CostMap costs(costMap ? width : 0, costMap ? height : 0);
+    if (costMap)
+        scene.setCostMap(&costs);
+
+    Image img(width, height, framebuffer);
+    vector<unsigned> perLevel(ladder.size(), 0);
+    size_t done = 0;
+    for (; done != tiles.size() && left() > 0; ++done)
+    {
+        // step up when ahead of the estimate, down when behind
+        Tile const &tile = tiles[done];
+        while (level > 0 && fits(level - 1))
+            --level;
+        while (level + 1 < ladder.size() && !fits(level))
+            ++level;
+
+        scene.setSuperSamplingFactor(ladder[level].superSampling);
+        scene.setMaxRecursionDepth(ladder[level].depth);
+        Image band(tile.x1 - tile.x0, tile.y1 - tile.y0);
+        auto tileStart = Clock::now();
+        scene.render(band, tile.x0, tile.y0, height);
+        double elapsed = chrono::duration<double>(Clock::now() - tileStart).count();
+
+        for (unsigned y = 0; y != band.height(); ++y)
+            for (unsigned x = 0; x != band.width(); ++x)
+                img.store(tile.x0 + x, tile.y0 + y, band.load(x, y));
+
+        double tileEstimate = tile.cost * band.width() * band.height();
+        traced += tileEstimate;
+        spent += tileEstimate > 0 ? elapsed / factor(ladder[level]) : 0;
+        ++perLevel[level];
+    }
+    scene.setSuperSamplingFactor(superSampling);
+    scene.setMaxRecursionDepth(depth);
+    scene.setCostMap(nullptr);
+
+    // Out of time: the nearest first pass sample
+    for (size_t idx = done; idx != tiles.size(); ++idx)
+    {
+        Tile const &tile = tiles[idx];
+        for (unsigned y = tile.y0; y != tile.y1; ++y)
+            for (unsigned x = tile.x0; x != tile.x1; ++x)
+                img.store(x, y, probe.load(x - x % PROBE, y - y % PROBE));
+    }
+
+    out() << "Traced in " << chrono::duration<double>(Clock::now() - start).count()
+           << " s of " << seconds << " s. Tiles per quality:";
+    for (size_t lvl = 0; lvl != ladder.size(); ++lvl)
+        if (perLevel[lvl])
+            out() << " ss " << ladder[lvl].superSampling << " depth "
+                   << ladder[lvl].depth << ": " << perLevel[lvl] << ',';
+    out() << " first pass only: " << tiles.size() - done << ".\n";
+
+    // Tiles left to the first pass keep a zero cost
+    if (costMap)
+    {
+        string stem = ofname.substr(0, ofname.find_last_of('.'));
+        CostTotal total = costs.total();
+        out() << "Cost: " << total.rays << " rays, " << total.tests
+               << " intersection tests, written to " << stem << "-cost-*.png and "
+               << stem << "-cost.pfm\n";
+        costs.write_heatmaps(stem + "-cost");
+        costs.write_pfm(stem + "-cost.pfm");
+    }
+
+    out() << "Writing image to " << ofname << "...\n";
+    bool ppm = ofname.size() >= 4
+        && ofname.compare(ofname.size() - 4, 4, ".ppm") == 0;
+    if (streaming || ppm)
+    {
+        ImageStreamPtr stream = openImageStream(ofname, width, height,
+                                                compression);
+        for (unsigned y = 0; y != height; ++y)
+            stream->write_row(img, y);
+        stream->close();
+    }
+    else
+        img.write_png(ofname, compression);
+    out() << "Done.\n";
+}
+
+string Raytracer::frameName(string const &ofname, unsigned frame)
+{
+    size_t dot = ofname.find_last_of('.');
+    if (dot == string::npos || ofname.find('/', dot) != string::npos)
+        dot = ofname.size();
+    char number[16];
+    snprintf(number, sizeof number, "-%04u", frame);
+    return ofname.substr(0, dot) + number + ofname.substr(dot);
+}
+
+void Raytracer::renderFrames(string const &ofname, unsigned first, unsigned last)
 {
-    // TODO: the size may be a settings in your file
-    Image img(400, 400);
-    cout << "Tracing...\n";
-    scene.render(img);
-    cout << "Writing image to " << ofname << "...\n";
-    img.write_png(ofname);
-    cout << "Done.\n";
+    if (animation.frames() == 0)
+        throw runtime_error("The scene has no Animation");
+    if (first > last || last >= animation.frames())
+        throw runtime_error("Frames must lie in 0-" + to_string(animation.frames() - 1));
+
+    out() << "Tracing frames " << first << " - " << last << "...\n";
+    auto start = chrono::steady_clock::now();
+
+    // While frame n is traced the thread of frame n - 1 encodes and writes
+    // it, the next frame only waits for that at its end
+    thread writer;
+    exception_ptr writeError;
+    auto finishWrite = [&]()
+    {
+        if (writer.joinable())
+            writer.join();
+        if (writeError)
+            rethrow_exception(writeError);
+    };
+
+    for (unsigned frame = first; frame <= last; ++frame)
+    {
+        auto frameStart = chrono::steady_clock::now();
+        animation.pose(frame, scene, lights, objectRanges);
+        Image img(width, height, framebuffer);
+        scene.render(img);
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - frameStart;
+
+        finishWrite();
+        string name = frameName(ofname, frame);
+        out() << "Traced " << name << " in " << elapsed.count() << " s.\n";
+        writer = thread([this, &writeError, name](Image const &img)
+            {
+                try
+                {
+                    img.write_png(name, compression);
+                }
+                catch (...)
+                {
+                    writeError = current_exception();
+                }
+            }, move(img));
+    }
+    finishWrite();
+
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    out() << "Wrote " << last - first + 1 << " frames in " << elapsed.count()
+           << " s.\n";
+}
+
+void Raytracer::renderRegion(string const &ofname, Region const &region)
+{
+    if (region.x1 > width || region.y1 > height)
+        throw runtime_error("Region lies outside the image");
+
+    out() << "Tracing region " << region.x0 << ',' << region.y0 << " - "
+           << region.x1 << ',' << region.y1 << "...\n";
+    auto start = chrono::steady_clock::now();
+
+    Image img(region.width(), region.height());
+    scene.render(img, region.x0, region.y0, height);
+    writePartial(ofname, region, width, height, framebuffer, img);
+
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    out() << "Wrote " << ofname << " in " << elapsed.count() << " s.\n";
+}
+
+void Raytracer::renderDistributed(string const &ofname, unsigned workers)
+{
+    if (workers == 0 || workers > height)
+        throw runtime_error("Need between 1 and height workers");
+
+    out() << "Tracing with " << workers << " worker processes...\n";
+    auto start = chrono::steady_clock::now();
+
+    // The scene is already parsed, the children inherit it
+    vector<string> partials;
+    vector<pid_t> children;
+    for (unsigned idx = 0; idx != workers; ++idx)
+    {
+        partials.push_back(ofname + ".part" + to_string(idx));
+        string tile = to_string(idx) + '/' + to_string(workers);
+
+        out().flush();
+        pid_t pid = fork();
+        if (pid < 0)
+            throw runtime_error("fork failed");
+        if (pid == 0)
+        {
+            int status = 0;
+            try
+            {
+                renderRegion(partials.back(), parseTile(tile, width, height));
+            }
+            catch (exception const &ex)
+            {
+                cerr << ex.what() << '\n';
+                status = 1;
+            }
+            out().flush();
+            _exit(status);
+        }
+        children.push_back(pid);
+    }
+
+    bool failed = false;
+    for (pid_t pid : children)
+    {
+        int status;
+        if (waitpid(pid, &status, 0) < 0
+            || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            failed = true;
+    }
+    if (failed)
+        throw runtime_error("A worker failed, partials are left in place");
+
+    out() << "Merging into " << ofname << "...\n";
+    mergePartials(partials, ofname, compression);
+    for (string const &partial : partials)
+        remove(partial.c_str());
+
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    out() << "Done in " << elapsed.count() << " s.\n";
+}
+
+Scene &Raytracer::getScene()
+{
+    return scene;
+}
+
+void Raytracer::setMessages(ostream *out)
+{
+    messages = out;
+}
+
+ostream &Raytracer::out() const
+{
+    return messages ? *messages : cout;
+}
+
+size_t Raytracer::getTextureBudget() const
+{
+    return textureBudget;
+}
+
+unsigned Raytracer::getWidth() const
+{
+    return width;
+}
+
+unsigned Raytracer::getHeight() const
+{
+    return height;
+}
+
+void Raytracer::renderStreaming(string const &ofname)
+{
+    out() << "Tracing and streaming " << width << 'x' << height
+           << " image to " << ofname << "...\n";
+    auto start = chrono::steady_clock::now();
+
+    ImageStreamPtr stream = openImageStream(ofname, width, height,
+                                            compression);
+
+    // A band is one row of tiles, so tiled traversal orders stay intact.
+    // Row y of the frame is quantized in row y % 4 of rows, which dithers
+    // it as in an image of the whole frame.
+    unsigned bandHeight = scene.getTileSize();
+    Image band(width, bandHeight);
+    Image rows(width, 4, framebuffer);
+    for (unsigned y0 = 0; y0 < height; y0 += bandHeight)
+    {
+        if (height - y0 < bandHeight)
+            band = Image(width, height - y0);
+
+        scene.render(band, 0, y0, height);
+        for (unsigned y = 0; y != band.height(); ++y)
+        {
+            unsigned row = (y0 + y) & 3;
+            for (unsigned x = 0; x != width; ++x)
+                rows.store(x, row, band.load(x, y));
+            stream->write_row(rows, row);
+        }
+    }
+    stream->close();
+
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    out() << "Done in " << elapsed.count() << " s.\n";
 }
 
 bool Raytracer::initializeMesh (json const &node) {
@@ -183,6 +1118,7 @@ bool Raytracer::initializeMesh (json const &node) {
     name = j.get<std::string>(); // Get name
         
     OBJLoader objl(name); // Load object
+    assets.push_back(name);
         
     vector<Vertex> vertices = objl.vertex_data(); //Get vertices of object
         
@@ -190,10 +1126,10 @@ bool Raytracer::initializeMesh (json const &node) {
         
     if(!scaleAndOffset.is_array()) return false;
         
-    double scale = scaleAndOffset[0];
-    double offsetX = scaleAndOffset[1];
-    double offsetY = scaleAndOffset[2];
-    double offsetZ = scaleAndOffset[3];
+    Real scale = scaleAndOffset[0];
+    Real offsetX = scaleAndOffset[1];
+    Real offsetY = scaleAndOffset[2];
+    Real offsetZ = scaleAndOffset[3];
         
     Material material = parseMaterialNode(node["material"]); //Parse material
         
@@ -203,7 +1139,7 @@ bool Raytracer::initializeMesh (json const &node) {
         Point v1(vertices[i].x*scale+offsetX, vertices[i].y*scale+offsetY, vertices[i].z*scale+offsetZ);
         Point v2(vertices[i+1].x*scale+offsetX , vertices[i+1].y*scale+offsetY, vertices[i+1].z*scale+offsetZ);
         Point v3(vertices[i+2].x*scale+offsetX , vertices[i+2].y*scale+offsetY, vertices[i+2].z*scale+offsetZ);
-        ObjectPtr obj = ObjectPtr(new Triangle(v1,v2,v3));
+        ObjectPtr obj = scene.createObject<Triangle>(v1,v2,v3);
         obj->material = material;
         scene.addObject(obj);
     }
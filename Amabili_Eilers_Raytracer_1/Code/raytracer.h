@@ -1,9 +1,16 @@
 #ifndef RAYTRACER_H_
 #define RAYTRACER_H_
 
+#include "animation.h"
+#include "image.h"
+#include "png.h"
+#include "region.h"
 #include "scene.h"
 
+#include <cstdint>
+#include <iosfwd>
 #include <string>
+#include <vector>
 
 // Forward declerations
 class Light;
@@ -14,18 +21,109 @@ class Material;
 class Raytracer
 {
     Scene scene;
+    unsigned width = 400;           // output resolution
+    unsigned height = 400;
+    bool streaming = false;         // stream rows to the file (see below)
+    PngCompression compression = PngCompression::Default;
+    PixelFormat framebuffer = PixelFormat::Float;
+    unsigned checkpointInterval = 60;   // seconds, 0 disables checkpoints
+    uint64_t sceneHash = 0;             // scene and assets, for checkpoints
+    unsigned denoiseIterations = 0;     // 0: no denoising
+    bool auxBuffers = false;            // also write normal/depth/albedo
+    bool costMap = false;               // also write per pixel cost
+    size_t textureBudget = 0;           // bytes, 0: not set by the scene
+    std::string sceneDirectory;         // textures are relative to it
+    std::vector<std::string> assets;    // mesh and texture files read
+    std::vector<Light> lights;          // as parsed, animation poses these
+    std::vector<ObjectRange> objectRanges;  // per "Objects" element
+    Animation animation;
+    std::ostream *messages = nullptr;   // progress output, null: std::cout
 
     public:
 
         bool readScene(std::string const &ifname);
-        void renderToFile(std::string const &ofname);
+        // directory (ending in '/', or empty) is where texture paths in
+        // the scene are relative to
+        bool readScene(std::istream &in, std::string const &directory = "");
+        // With resume the render continues from ofname.ckpt if it was left
+        // by an interrupted render of the same scene and settings
+        void renderToFile(std::string const &ofname, bool resume = false);
+
+        // Render frames first to last of the scene's animation, each to
+        // ofname with the frame number before the extension (out-0007.png).
+        // Assets are loaded once, objects move in place between frames and
+        // each frame is written while the next one is traced.
+        void renderFrames(std::string const &ofname, unsigned first,
+                          unsigned last);
+
+        // Render to ofname, then keep watching ifname (the scene this was
+        // read from) and render again whenever it changes, until killed.
+        // When only materials changed, only the pixels showing the edited
+        // objects (directly or in a reflection) are traced again.
+        void watch(std::string const &ifname, std::string const &ofname);
+
+        // Quick look first: write a 1/8 resolution image without shadows
+        // and reflections to <stem>-preview.png, then overwrite it with
+        // 1/4 and 1/2 resolution images, and finally render ofname. The
+        // 1/4 and 1/2 levels trace one sample per pixel at full resolution
+        // pixel centres, without supersampling the final pass keeps them.
+        void renderProgressive(std::string const &ofname);
+
+        // Render ofname within seconds of wall-clock time, the first pass
+        // included. A sparse first pass measures what every tile costs,
+        // then the tiles are traced, the most detailed first, at the best
+        // supersampling factor and reflection depth that fits the rest of
+        // the budget, stepping down when it runs behind. Tiles still left
+        // at the deadline are filled in from the first pass. The image is
+        // not denoised.
+        void renderDeadline(std::string const &ofname, double seconds);
+
+        // Render only region and write it as a partial (see region.h)
+        void renderRegion(std::string const &ofname, Region const &region);
+
+        // Fork workers that each render a band of rows to ofname.part<i>,
+        // then merge the partials into ofname and remove them
+        void renderDistributed(std::string const &ofname, unsigned workers);
+
+        // The scene as read, e.g. to render it with a Renderer
+        Scene &getScene();
+
+        unsigned getWidth() const;
+        unsigned getHeight() const;
+
+        // The scene's "TextureBudget" in bytes, 0 if it sets none. The
+        // texture cache is shared by the whole process, so readScene leaves
+        // its budget alone; a program rendering just this scene applies it
+        // with TextureCache::setBudget (watch does so itself).
+        size_t getTextureBudget() const;
+
+        // Send the progress messages of readScene and the renders to out
+        // instead of std::cout, nullptr restores std::cout. Errors still
+        // go to std::cerr.
+        void setMessages(std::ostream *out);
+
+        // Replace the eye, lights and/or size by the "Eye", "Lights" and
+        // "Size" members of node (same format as the scene file), members
+        // that are missing are left alone. Throws on malformed values.
+        void applyOverrides(nlohmann::json const &node);
+
+        // ofname with "-<frame>" (4 digits) before its extension
+        static std::string frameName(std::string const &ofname, unsigned frame);
 
     private:
 
+        std::ostream &out() const;      // where progress messages go
+
+        // Render one band of rows at a time and write each band straight to
+        // an ImageStream, so memory stays at one band regardless of size.
+        // Used when the scene asks for it, for .ppm output and for images
+        // above STREAMING_PIXELS.
+        void renderStreaming(std::string const &ofname);
+
         bool parseObjectNode(nlohmann::json const &node);
         bool initializeMesh(nlohmann::json const &node);
         Light parseLightNode(nlohmann::json const &node) const;
-        Material parseMaterialNode(nlohmann::json const &node) const;
+        Material parseMaterialNode(nlohmann::json const &node);
 };
 
 #endif
@@ -0,0 +1,186 @@
+#include "region.h"
+
+#include "image.h"
+#include "imagestream.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace
+{
+    char const MAGIC[8] = {'R', 'A', 'Y', 'P', 'A', 'R', 'T', '3'};
+
+    // framebuffer format, frame width and height, x0, y0, x1, y1
+    size_t const HEADER_FIELDS = 7;
+
+    // channels per pixel, as float
+    size_t const PIXEL_BYTES = 3 * sizeof(float);
+
+    // A partial being merged, its rows are read in order
+    struct Part
+    {
+        string filename;
+        Region region;
+        unique_ptr<ifstream> in;        // open while its rows are merged
+    };
+
+    bool overlap(Region const &a, Region const &b)
+    {
+        return a.x0 < b.x1 && b.x0 < a.x1 && a.y0 < b.y1 && b.y0 < a.y1;
+    }
+}
+
+Region parseRegion(string const &spec)
+{
+    istringstream in(spec);
+    Region region;
+    char c1, c2, c3;
+    if (!(in >> region.x0 >> c1 >> region.y0 >> c2 >> region.x1 >> c3 >> region.y1)
+        || c1 != ',' || c2 != ',' || c3 != ','
+        || region.x1 <= region.x0 || region.y1 <= region.y0)
+        throw runtime_error("Region must be x0,y0,x1,y1 with x0 < x1 and y0 < y1");
+    return region;
+}
+
+Region parseTile(string const &spec, unsigned width, unsigned height)
+{
+    istringstream in(spec);
+    unsigned index, count;
+    char slash;
+    if (!(in >> index >> slash >> count) || slash != '/'
+        || count == 0 || index >= count || count > height)
+        throw runtime_error("Tile must be i/N with 0 <= i < N <= height");
+
+    Region region;
+    region.x0 = 0;
+    region.x1 = width;
+    region.y0 = static_cast<unsigned>(uint64_t(height) * index / count);
+    region.y1 = static_cast<unsigned>(uint64_t(height) * (index + 1) / count);
+    return region;
+}
+
+void writePartial(string const &filename, Region const &region,
+                  unsigned frameWidth, unsigned frameHeight,
+                  PixelFormat framebuffer, Image const &pixels)
+{
+    ofstream out(filename, ios::binary);
+    if (!out)
+        throw runtime_error("Could not open " + filename + " for writing");
+
+    uint32_t header[HEADER_FIELDS] = {
+        uint32_t(framebuffer), frameWidth, frameHeight,
+        region.x0, region.y0, region.x1, region.y1
+    };
+    out.write(MAGIC, sizeof(MAGIC));
+    out.write(reinterpret_cast<char const *>(header), sizeof(header));
+
+    vector<float> line(3 * region.width());
+    for (unsigned y = 0; y != region.height(); ++y)
+    {
+        for (unsigned x = 0; x != region.width(); ++x)
+        {
+            Color pixel = pixels.load(x, y);
+            for (unsigned idx = 0; idx != 3; ++idx)
+                line[3 * x + idx] = float(pixel.data[idx]);
+        }
+        out.write(reinterpret_cast<char const *>(line.data()),
+                  PIXEL_BYTES * region.width());
+    }
+
+    if (!out)
+        throw runtime_error("Writing " + filename + " failed");
+}
+
+void mergePartials(vector<string> const &partials, string const &ofname,
+                   PngCompression compression)
+{
+    if (partials.empty())
+        throw runtime_error("No partials to merge");
+
+    // Check the headers first: together the regions must tile the frame
+    vector<Part> parts;
+    uint32_t first[HEADER_FIELDS] = {};
+    size_t area = 0;
+    for (string const &filename : partials)
+    {
+        ifstream in(filename, ios::binary);
+        char magic[sizeof(MAGIC)];
+        uint32_t header[HEADER_FIELDS];
+        if (!in.read(magic, sizeof(magic))
+            || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0
+            || !in.read(reinterpret_cast<char *>(header), sizeof(header)))
+            throw runtime_error(filename + " is not a partial render");
+        if (header[0] > uint32_t(PixelFormat::RGBA16F))
+            throw runtime_error(filename + " has an unknown framebuffer format");
+
+        if (parts.empty())
+            copy(header, header + HEADER_FIELDS, first);
+        else if (header[1] != first[1] || header[2] != first[2])
+            throw runtime_error(filename + " belongs to a frame of another size");
+        else if (header[0] != first[0])
+            throw runtime_error(filename + " has another framebuffer format");
+
+        Region region = {header[3], header[4], header[5], header[6]};
+        if (region.x1 > first[1] || region.y1 > first[2]
+            || region.x1 <= region.x0 || region.y1 <= region.y0)
+            throw runtime_error(filename + " has an invalid region");
+        for (Part const &part : parts)
+            if (overlap(part.region, region))
+                throw runtime_error(filename + " overlaps another partial");
+        streamoff bytes = sizeof(MAGIC) + sizeof(header) + PIXEL_BYTES
+            * streamoff(region.width()) * region.height();
+        if (!in.seekg(0, ios::end) || streamoff(in.tellg()) < bytes)
+            throw runtime_error(filename + " is truncated");
+
+        area += size_t(region.width()) * region.height();
+        parts.push_back(Part{filename, region, nullptr});
+    }
+
+    PixelFormat format = PixelFormat(first[0]);
+    unsigned frameWidth = first[1];
+    unsigned frameHeight = first[2];
+    if (area != size_t(frameWidth) * frameHeight)
+        throw runtime_error("The partials do not cover the whole frame");
+
+    // Then a row at a time, every partial is open only while the rows
+    // pass its region. Row y of the frame goes to row y % 4 of rows, so
+    // it is dithered as in an image of the whole frame.
+    ImageStreamPtr out = openImageStream(ofname, frameWidth, frameHeight,
+                                         compression);
+    Image rows(frameWidth, 4, format);
+    vector<float> line(3 * frameWidth);
+    for (unsigned y = 0; y != frameHeight; ++y)
+    {
+        for (Part &part : parts)
+        {
+            Region const &region = part.region;
+            if (y < region.y0 || y >= region.y1)
+                continue;
+            if (y == region.y0)
+            {
+                part.in.reset(new ifstream(part.filename, ios::binary));
+                part.in->seekg(sizeof(MAGIC) + HEADER_FIELDS * sizeof(uint32_t));
+            }
+
+            part.in->read(reinterpret_cast<char *>(line.data()),
+                          PIXEL_BYTES * region.width());
+            if (!*part.in)
+                throw runtime_error(part.filename + " is truncated");
+            for (unsigned x = 0; x != region.width(); ++x)
+                rows.store(region.x0 + x, y & 3, Color(line[3 * x],
+                           line[3 * x + 1], line[3 * x + 2]));
+
+            if (y + 1 == region.y1)
+                part.in.reset();
+        }
+        out->write_row(rows, y & 3);
+    }
+    out->close();
+}
@@ -0,0 +1,45 @@
+#ifndef REGION_H_
+#define REGION_H_
+
+#include "image.h"
+#include "png.h"
+#include "triple.h"
+
+#include <string>
+#include <vector>
+
+// A rectangle of pixels [x0, x1) x [y0, y1) within a frame, y pointing down
+// like Image rows.
+struct Region
+{
+    unsigned x0, y0, x1, y1;
+
+    unsigned width() const  { return x1 - x0; }
+    unsigned height() const { return y1 - y0; }
+};
+
+// "x0,y0,x1,y1", throws runtime_error if malformed
+Region parseRegion(std::string const &spec);
+
+// "i/N": band i (0 based) of N equally high bands of rows of the frame,
+// throws runtime_error if malformed
+Region parseTile(std::string const &spec, unsigned width, unsigned height);
+
+// A partial render: the region's colors as float channels plus where they
+// go in the frame and the frame's framebuffer format. The layout is native
+// endian, so partials are merged by builds for the same platform; float and
+// double builds read each other's. Both throw runtime_error on I/O errors.
+void writePartial(std::string const &filename, Region const &region,
+                  unsigned frameWidth, unsigned frameHeight,
+                  PixelFormat framebuffer, Image const &pixels);
+
+// Assemble partials into the final image (.ppm or PNG), quantized to their
+// framebuffer format like renderToFile does. Streams a row at a time, so
+// memory stays at a few rows regardless of the frame size. Throws
+// runtime_error if the partials disagree on the frame size or format,
+// overlap or leave pixels uncovered.
+void mergePartials(std::vector<std::string> const &partials,
+                   std::string const &ofname,
+                   PngCompression compression = PngCompression::Default);
+
+#endif
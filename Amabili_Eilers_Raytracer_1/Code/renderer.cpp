@@ -0,0 +1,72 @@
+#include "renderer.h"
+
+#include "image.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+// a multiple of 4, so the dither pattern lines up with the whole frame
+static unsigned const BAND_HEIGHT = 16;
+
+static_assert(sizeof(Rgb8) == 3 && sizeof(Rgb32f) == 3 * sizeof(float),
+              "rows are copied as they are");
+
+Renderer::Renderer(Scene const &scene, ThreadPool &pool)
+:
+    d_scene(scene),
+    d_pool(pool)
+{}
+
+void Renderer::render(vector<RenderJob> const &jobs)
+{
+    for (RenderJob const &job : jobs)
+    {
+        FrameBuffer const &target = job.target;
+        size_t rowBytes = size_t(target.width)
+            * (target.format == BufferFormat::RGB8 ? 3 : 3 * sizeof(float));
+        if (!target.pixels || target.stride < rowBytes)
+            throw runtime_error("Render job without a large enough buffer");
+    }
+
+    // per worker copies of this call, the scene may have changed since
+    // the last one
+    vector<Scene> contexts(d_pool.size(), d_scene);
+
+    // the pool may run other work, wait for these bands only
+    TaskGroup bands(d_pool);
+    for (RenderJob const &job : jobs)
+        for (unsigned y0 = 0; y0 < job.target.height; y0 += BAND_HEIGHT)
+            bands.submit([this, &contexts, &job, y0](unsigned worker)
+                {
+                    renderBand(contexts[worker], job, y0);
+                });
+    bands.wait();
+}
+
+void Renderer::renderBand(Scene &scene, RenderJob const &job, unsigned y0)
+{
+    FrameBuffer const &target = job.target;
+    scene.setEye(job.eye);
+
+    unsigned rows = min(BAND_HEIGHT, target.height - y0);
+    bool rgb8 = target.format == BufferFormat::RGB8;
+    Image band(target.width, rows, rgb8 ? PixelFormat::RGB8 : PixelFormat::Float);
+    scene.render(band, 0, y0, target.height);
+
+    unsigned char *base = static_cast<unsigned char *>(target.pixels);
+    for (unsigned y = 0; y != rows; ++y)
+    {
+        unsigned char *row = base + (y0 + y) * target.stride;
+        if (rgb8)
+        {
+            memcpy(row, band.rgb8_row(y), target.width * sizeof(Rgb8));
+            continue;
+        }
+
+        memcpy(row, band.float_row(y), target.width * sizeof(Rgb32f));
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef RENDERER_H_
+#define RENDERER_H_
+
+#include "scene.h"
+#include "triple.h"
+
+#include <cstddef>
+#include <vector>
+
+class ThreadPool;
+
+// Pixel layouts of a caller's buffer
+enum class BufferFormat
+{
+    RGB8,       // 3 bytes per pixel, dithered like an RGB8 framebuffer
+    RGBFloat    // 3 floats per pixel, in [0, 1]
+};
+
+// Memory a job renders into: height rows of width pixels, rows stride
+// bytes apart, top row first. Owned by the caller.
+struct FrameBuffer
+{
+    void *pixels;
+    unsigned width;
+    unsigned height;
+    size_t stride;
+    BufferFormat format;
+};
+
+// One view of the scene
+struct RenderJob
+{
+    Point eye;
+    FrameBuffer target;
+};
+
+// Embedding API: render views of one in-memory Scene into the caller's
+// buffers, on the threads of a pool shared with other work. Build the scene
+// with Scene::createObject / addObject / addLight and the setters (or read
+// it with Raytracer::readScene and take Raytracer::getScene), then
+//
+//     ThreadPool pool;
+//     Renderer renderer(scene, pool);
+//     renderer.render(jobs);
+//
+// Every worker traces with its own copy of the scene (the objects are
+// shared), so the scene must not change while render runs. The copies
+// belong to a single render call, render may run on several threads at
+// once.
+class Renderer
+{
+    Scene const &d_scene;
+    ThreadPool &d_pool;
+
+    public:
+        Renderer(Scene const &scene, ThreadPool &pool);
+
+        // Render every job, returns when all are done. The jobs are split
+        // in bands of rows that run on the pool in any order. Throws what
+        // a band threw (the other bands still finish).
+        void render(std::vector<RenderJob> const &jobs);
+
+    private:
+        // scene is the calling worker's copy
+        void renderBand(Scene &scene, RenderJob const &job, unsigned y0);
+};
+
+#endif
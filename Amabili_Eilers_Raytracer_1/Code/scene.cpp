@@ -1,22 +1,44 @@
 #include "scene.h"
 
+#include "contributions.h"
+#include "costmap.h"
+#include "denoise.h"
+#include "hash.h"
 #include "hit.h"
 #include "image.h"
 #include "material.h"
 #include "ray.h"
+#include "texture.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <limits>
-
-#define BIAS 1e-5
+#include <stdexcept>
+#include <string>
 
 using namespace std;
 
+// offset of secondary ray origins, depends on the precision (see precision.h)
+static Real const BIAS = Precision<Real>::bias();
+
 Color Scene::trace(Ray const &ray)
+{
+    bool reflections = maxRecursionDepth != 0;
+    if (shadows)
+        return reflections ? traceKernel<true, true>(ray)
+                           : traceKernel<true, false>(ray);
+    return reflections ? traceKernel<false, true>(ray)
+                       : traceKernel<false, false>(ray);
+}
+
+template <bool Shadows, bool Reflections>
+Color Scene::traceKernel(Ray const &ray, Real spread)
 {
     // Find hit object and distance
-    Hit min_hit(numeric_limits<double>::infinity(), Vector());
+    Hit min_hit(numeric_limits<Real>::infinity(), Vector());
     ObjectPtr obj = nullptr;
+    unsigned objIdx = 0;
     for (unsigned idx = 0; idx != objects.size(); ++idx)
     {
         Hit hit(objects[idx]->intersect(ray));
@@ -24,55 +46,76 @@ Color Scene::trace(Ray const &ray)
         {
             min_hit = hit;
             obj = objects[idx];
+            objIdx = idx;
         }
     }
+    ++rayCount;
+    testCount += objects.size();
 
     // No hit? Return background color.
     if (!obj) return Color(0.0, 0.0, 0.0);
+    if (contributions)
+        touched.push_back(objIdx);
 
     Material material = obj->material;             //the hit objects material
     Point hit = ray.at(min_hit.t);                 //the hit point
     Vector N = min_hit.N;                          //the normal at hit point
+    if (material.texture)
+        material.color = textureColor(*obj, hit, N, ray.D, min_hit.t * spread);
     Vector V = -ray.D;                             //View direction 
     Vector R = N*2*V.dot(N) - V;                   //Reflection vector
     Ray reflectionRay(hit + N*BIAS, R);            //Reflection ray
     
-    if(shadows) {
+    LightBatch batch;
+    if(Shadows) {
         Color color = material.color*material.ka;
-        
-        //Checking if the intersection point is in the shadows of another object
-        
-        for(auto light : lights) {
-            Hit min_hit(numeric_limits<double>::infinity(), Vector());
-            bool shadowed = false;
-            Vector L = (light->position - hit).normalized();
-            Ray r(hit + N*BIAS, L);
-            for (unsigned idx = 0; idx != objects.size(); ++idx)
+        Point origin = hit + N*BIAS;
+
+        if (cullLights)
+            color += culledLighting(material, hit, N, V, origin, true);
+        else for (size_t first = 0; first < lights.size(); first += LightBatch::SIZE)
+        {
+            unsigned count = min<size_t>(LightBatch::SIZE, lights.size() - first);
+            shadeLights(material, hit, N, V, first, count, batch);
+
+            //Checking if the intersection point is in the shadows of another object
+            for (unsigned i = 0; i != count; ++i)
             {
-                Hit h(objects[idx]->intersect(r));
-                if (h.t < min_hit.t)
-                {
-                    shadowed = true;
-                    break;
-                } 
-                
+                Ray r(origin, Vector(batch.lx[i], batch.ly[i], batch.lz[i]));
+                if(!occluded(r, first + i)) color += Color(batch.r[i], batch.g[i], batch.b[i]);
             }
-            if(!shadowed) color += getDiffuseAndSpecularLighting(material, hit, N, V, light);
         }
         
-        color += getSpecularReflection(material,reflectionRay,N,material.ks, Color(0.0,0.0,0.0), 0);
+        if(Reflections)
+            color += getSpecularReflection(material,reflectionRay,N,material.ks, Color(0.0,0.0,0.0), 0, spread, min_hit.t);
         return color;
     }
     
     //Get full phong lighting
     Color color(0.0,0.0,0.0);
-        
-    for (auto light : lights) {
-        color += getDiffuseAndSpecularLighting(material, hit, N, V, light);
-        color += getSpecularReflection(material, reflectionRay, N, material.ks , Color(0.0,0.0,0.0) , 0);
-    }
 
-    
+    // the reflection goes in once per light, it is the same for all of them
+    Color reflection(0.0,0.0,0.0);
+    if(Reflections && lights.size() != 0)
+        reflection = getSpecularReflection(material, reflectionRay, N, material.ks , Color(0.0,0.0,0.0) , 0, spread, min_hit.t);
+
+    if (cullLights)
+    {
+        color += culledLighting(material, hit, N, V, hit, false);
+        if(Reflections)
+            color += reflection * Real(lights.size());
+    }
+    else for (size_t first = 0; first < lights.size(); first += LightBatch::SIZE)
+    {
+        unsigned count = min<size_t>(LightBatch::SIZE, lights.size() - first);
+        shadeLights(material, hit, N, V, first, count, batch);
+        for (unsigned i = 0; i != count; ++i)
+        {
+            color += Color(batch.r[i], batch.g[i], batch.b[i]);
+            if(Reflections)
+                color += reflection;
+        }
+    }
 
     color += material.color*material.ka;
 
@@ -80,40 +123,332 @@ Color Scene::trace(Ray const &ray)
     return color;
 }
 
+Color Scene::culledLighting(Material const &material, Point const &hit,
+                            Vector const &N, Vector const &V,
+                            Point const &origin, bool shadows)
+{
+    if (lightClusters.empty())
+    {
+        lightClusters = clusterLights(lights, LightBatch::SIZE);
+        lastOccluder.clear();
+    }
+
+    // most a light of unit color can add to any channel of this material
+    Real reach = material.kd * max(material.color.r, max(material.color.g,
+                 material.color.b)) + material.ks;
+
+    Color color(0.0, 0.0, 0.0);
+    candidates.clear();
+    LightBatch batch;
+    for (LightCluster const &cluster : lightClusters)
+    {
+        if (cluster.maxColor * reach < lightCulling.threshold
+            || (lightCulling.horizon && cluster.behind(hit, N)))
+            continue;
+
+        shadeLights(material, hit, N, V, cluster.first, cluster.count, batch);
+        for (unsigned i = 0; i != cluster.count; ++i)
+        {
+            Real strength = max(batch.r[i], max(batch.g[i], batch.b[i]));
+            if (strength <= 0 || strength < lightCulling.threshold)
+                continue;
+
+            Color light(batch.r[i], batch.g[i], batch.b[i]);
+            if (!shadows)
+                color += light;
+            else
+                candidates.push_back({Vector(batch.lx[i], batch.ly[i], batch.lz[i]),
+                                      light, strength, cluster.first + i});
+        }
+    }
+
+    unsigned samples = lightCulling.shadowSamples;
+    if (samples == 0 || candidates.size() <= samples)
+    {
+        for (ShadowCandidate const &light : candidates)
+            if (!occluded(Ray(origin, light.L), light.light))
+                color += light.color;
+        return color;
+    }
+
+    // Stratified samples over the lights by strength: a light with
+    // strength s gets s / step of the samples (rounded either way), each
+    // visible one adds its color weighted by step / s. The offset into the
+    // first stratum comes from the hit point, so renders are repeatable.
+    Real total = 0;
+    for (ShadowCandidate const &light : candidates)
+        total += light.strength;
+    Real step = total / samples;
+
+    uint64_t hash = FNV1A_OFFSET;
+    unsigned char const *bytes = reinterpret_cast<unsigned char const *>(hit.data);
+    for (size_t idx = 0; idx != 3 * sizeof(Real); ++idx)
+        hash = fnv1a(hash, bytes[idx]);
+    Real next = step * Real((hash >> 11) * (1.0 / 9007199254740992.0));
+
+    Real reached = 0;
+    for (ShadowCandidate const &light : candidates)
+    {
+        reached += light.strength;
+        unsigned picks = 0;
+        for (; next < reached && picks < samples; next += step)
+            ++picks;
+        if (picks != 0 && !occluded(Ray(origin, light.L), light.light))
+            color += light.color * (picks * step / light.strength);
+    }
+    return color;
+}
+
+bool Scene::occluded(Ray const &ray, size_t light)
+{
+    ++rayCount;
+    ++shadowStats.rays;
+    if (lastOccluder.size() != lights.size())
+        lastOccluder.assign(lights.size(), nullptr);
+
+    // Neighbouring hit points are mostly blocked by the same object, any
+    // blocker answers the query so try that one before the rest
+    ObjectPtr &last = lastOccluder[light];
+    if (last)
+    {
+        ++testCount;
+        if (last->intersect(ray).t < numeric_limits<Real>::infinity())
+        {
+            ++shadowStats.occluded;
+            ++shadowStats.cacheHits;
+            return true;
+        }
+    }
+
+    for (unsigned idx = 0; idx != objects.size(); ++idx)
+    {
+        if (objects[idx] == last)
+            continue;
+        ++testCount;
+        if (objects[idx]->intersect(ray).t < numeric_limits<Real>::infinity())
+        {
+            ++shadowStats.occluded;
+            last = objects[idx];
+            return true;
+        }
+    }
+    last = nullptr;
+    return false;
+}
+
 void Scene::render(Image &img)
+{
+    render(img, 0, 0, img.height());
+}
+
+void Scene::render(Image &img, unsigned x0, unsigned y0, unsigned frameHeight)
+{
+    // Select the kernel once, nothing below branches on the settings again
+    bool reflections = maxRecursionDepth != 0;
+    if (shadows)
+    {
+        if (reflections) renderFeatures<true, true>(img, x0, y0, frameHeight);
+        else             renderFeatures<true, false>(img, x0, y0, frameHeight);
+    }
+    else
+    {
+        if (reflections) renderFeatures<false, true>(img, x0, y0, frameHeight);
+        else             renderFeatures<false, false>(img, x0, y0, frameHeight);
+    }
+}
+
+void Scene::render(Image &img, vector<PixelOffset> const &pixels)
+{
+    pixelList = &pixels;
+    render(img);
+    pixelList = nullptr;
+}
+
+template <bool Shadows, bool Reflections>
+void Scene::renderFeatures(Image &img, unsigned x0, unsigned y0,
+                           unsigned frameHeight)
+{
+    switch (superSamplingFactor)
+    {
+        case 1:  renderKernel<Shadows, Reflections, 1>(img, x0, y0, frameHeight); break;
+        case 2:  renderKernel<Shadows, Reflections, 2>(img, x0, y0, frameHeight); break;
+        case 4:  renderKernel<Shadows, Reflections, 4>(img, x0, y0, frameHeight); break;
+        default: renderKernel<Shadows, Reflections, 0>(img, x0, y0, frameHeight); break;
+    }
+}
+
+template <bool Shadows, bool Reflections, unsigned SuperSampling>
+void Scene::renderKernel(Image &img, unsigned x0, unsigned y0,
+                         unsigned frameHeight)
 {
     unsigned w = img.width();
     unsigned h = img.height();
-    for (unsigned y = 0; y < h; ++y)
+
+    if (pixelList)
+    {
+        for (PixelOffset const &p : *pixelList)
+            shadePixel<Shadows, Reflections, SuperSampling>(
+                img, p.x, p.y, x0, y0, frameHeight);
+        return;
+    }
+
+    if (traversal == Traversal::RowMajor)
+    {
+        for (unsigned y = 0; y < h; ++y)
+            for (unsigned x = 0; x < w; ++x)
+                shadePixel<Shadows, Reflections, SuperSampling>(
+                    img, x, y, x0, y0, frameHeight);
+        return;
+    }
+
+    // Tiles in row major order, pixels along the curve within each tile
+    vector<PixelOffset> order = tileOrder(traversal, tileSize);
+    for (unsigned ty = 0; ty < h; ty += tileSize)
+    {
+        for (unsigned tx = 0; tx < w; tx += tileSize)
+        {
+            for (PixelOffset const &p : order)
+            {
+                unsigned x = tx + p.x;
+                unsigned y = ty + p.y;
+                if (x < w && y < h)
+                    shadePixel<Shadows, Reflections, SuperSampling>(
+                        img, x, y, x0, y0, frameHeight);
+            }
+        }
+    }
+}
+
+template <bool Shadows, bool Reflections, unsigned SuperSampling>
+inline void Scene::shadePixel(Image &img, unsigned x, unsigned y,
+                              unsigned x0, unsigned y0, unsigned frameHeight)
+{
+    if (!costMap)
+    {
+        img.store(x, y, samplePixel<Shadows, Reflections, SuperSampling>(
+            x0 + x, y0 + y, frameHeight));
+        if (contributions)
+        {
+            contributions->record(x0 + x, y0 + y, touched);
+            touched.clear();
+        }
+        return;
+    }
+
+    uint64_t rays = rayCount;
+    uint64_t tests = testCount;
+    auto start = chrono::steady_clock::now();
+    img.store(x, y, samplePixel<Shadows, Reflections, SuperSampling>(
+        x0 + x, y0 + y, frameHeight));
+    chrono::duration<float, nano> elapsed = chrono::steady_clock::now() - start;
+
+    PixelCost cost = {float(testCount - tests), float(rayCount - rays),
+                      elapsed.count()};
+    costMap->record(x0 + x, y0 + y, cost);
+    if (contributions)
+    {
+        contributions->record(x0 + x, y0 + y, touched);
+        touched.clear();
+    }
+}
+
+template <bool Shadows, bool Reflections, unsigned SuperSampling>
+Color Scene::samplePixel(unsigned x, unsigned y, unsigned h)
+{
+    //Super sampling, Standard super sampling factor is 1
+    unsigned const ss = SuperSampling ? SuperSampling : superSamplingFactor;
+    Real const ssFactor = ss;
+
+    Color col(0.0,0.0,0.0);
+    
+    for(unsigned i = 0; i < ss; i++) {
+        Real yCoord = h - 1 - y +  ((1.0+2.0*i)/(ssFactor*2.0));
+        for(unsigned j = 0; j < ss; j++) {
+            Real xCoord = x + ((1.0+2.0*j)/(ssFactor*2.0));
+            Point pixel (xCoord, yCoord);
+            Vector toPixel = pixel - eye;
+            Real distance = toPixel.length();
+            Ray ray(eye, toPixel / distance);
+            // a sample covers 1/ss pixel on the image plane
+            col += traceKernel<Shadows, Reflections>(ray, 1.0 / (ssFactor * distance));
+        }
+    }
+    
+    col = col/(ss*ss);
+    col.clamp();
+    return col;
+}
+
+void Scene::renderAux(AuxBuffers &aux)
+{
+    for (unsigned y = 0; y != aux.height; ++y)
     {
-        for (unsigned x = 0; x < w; ++x)
+        for (unsigned x = 0; x != aux.width; ++x)
         {
-            
-            //Super sampling, Standard super sampling factor is 1
-            
-            Color col(0.0,0.0,0.0);
-            double ssFactor = (double) superSamplingFactor;
-            
-            for(double i = 0; i < ssFactor; i++) {
-                double yCoord = h - 1 - y +  ((1.0+2.0*i)/(ssFactor*2.0));
-                for(double j = 0; j < superSamplingFactor; j++) {
-                    double xCoord = x + (double) ((1.0+2.0*j)/(ssFactor*2.0));
-                    Point pixel (xCoord, yCoord);
-                    Ray ray(eye, (pixel - eye).normalized());
-                    col += trace(ray);
+            Point pixel(x + 0.5, aux.height - 1 - y + 0.5);
+            Ray ray(eye, (pixel - eye).normalized());
+
+            Hit min_hit(numeric_limits<Real>::infinity(), Vector());
+            ObjectPtr obj = nullptr;
+            for (unsigned idx = 0; idx != objects.size(); ++idx)
+            {
+                Hit hit(objects[idx]->intersect(ray));
+                if (hit.t < min_hit.t)
+                {
+                    min_hit = hit;
+                    obj = objects[idx];
                 }
             }
-            
-            col = col/(superSamplingFactor*superSamplingFactor);
-            col.clamp();
-            img(x,y) = col;
-            
+
+            if (!obj)
+                continue;
+            size_t idx = size_t(y) * aux.width + x;
+            aux.normal[idx] = min_hit.N;
+            aux.depth[idx] = min_hit.t;
+            aux.albedo[idx] = obj->material.texture
+                ? textureColor(*obj, ray.at(min_hit.t), min_hit.N, ray.D, 0.0)
+                : obj->material.color;
         }
     }
 }
 
+Color Scene::textureColor(Object const &obj, Point const &hit, Vector const &N,
+                          Vector const &D, Real footprint) const
+{
+    // The footprint stretches by 1 / cos on a slanted surface along one
+    // axis only, the isotropic filter gets the same area
+    Real cosine = max(fabs(N.dot(D)), Real(0.01));
+    TexCoord uv = obj.map(hit, footprint / sqrt(cosine));
+    return obj.material.texture->sample(uv.u, uv.v, uv.width);
+}
+
 // --- Misc functions ----------------------------------------------------------
 
+void Scene::setCostMap(CostMap *map)
+{
+    costMap = map;
+}
+
+void Scene::setContributions(ContributionMap *map)
+{
+    contributions = map;
+}
+
+uint64_t Scene::getRayCount() const
+{
+    return rayCount;
+}
+
+uint64_t Scene::getTestCount() const
+{
+    return testCount;
+}
+
+ShadowStats Scene::getShadowStats() const
+{
+    return shadowStats;
+}
+
 void Scene::addObject(ObjectPtr obj)
 {
     objects.push_back(obj);
@@ -121,7 +456,14 @@ void Scene::addObject(ObjectPtr obj)
 
 void Scene::addLight(Light const &light)
 {
-    lights.push_back(LightPtr(new Light(light)));
+    lights.push_back(light);
+    lightClusters.clear();
+}
+
+void Scene::clearLights()
+{
+    lights.clear();
+    lightClusters.clear();
 }
 
 void Scene::setEye(Triple const &position)
@@ -134,11 +476,36 @@ unsigned Scene::getNumObject()
     return objects.size();
 }
 
+ObjectPtr Scene::getObject(unsigned idx)
+{
+    return objects[idx];
+}
+
 unsigned Scene::getNumLights()
 {
     return lights.size();
 }
 
+bool Scene::getShadows() const
+{
+    return shadows;
+}
+
+unsigned Scene::getTileSize() const
+{
+    return tileSize;
+}
+
+int Scene::getSuperSamplingFactor() const
+{
+    return superSamplingFactor;
+}
+
+int Scene::getMaxRecursionDepth() const
+{
+    return maxRecursionDepth;
+}
+
 void Scene::setShadows(bool s) {
     shadows = s;
 }
@@ -148,39 +515,137 @@ void Scene::setMaxRecursionDepth(int depth) {
 }
 
 void Scene::setSuperSamplingFactor(int factor) { 
+    // the kernels take factor x factor samples as an unsigned count
+    if (factor < 1)
+        throw runtime_error("SuperSamplingFactor must be at least 1");
     superSamplingFactor = factor;
 }
 
+void Scene::setTraversal(Traversal order, unsigned size) {
+    if (size == 0 || size > MAX_TILE_SIZE)
+        throw runtime_error("TileSize must be between 1 and "
+                            + to_string(MAX_TILE_SIZE));
+    traversal = order;
+    tileSize = size;
+}
+
+void Scene::setLightCulling(LightCulling const &settings) {
+    cullLights = true;
+    lightCulling = settings;
+    lightClusters.clear();
+}
+
+// pow(base[i], exponent) into out[i], consumes base. Whole exponents (the
+// usual Phong n) go by repeated squaring over all lanes at once, anything
+// else falls back to std::pow.
+static void powLanes(Real *base, Real *out, unsigned count, Real exponent)
+{
+    if (exponent < 0 || exponent > 1024 || exponent != floor(exponent))
+    {
+        for (unsigned i = 0; i != count; ++i)
+            out[i] = pow(base[i], exponent);
+        return;
+    }
+
+    for (unsigned i = 0; i != count; ++i)
+        out[i] = 1;
+    for (unsigned e = unsigned(exponent); e != 0; e >>= 1)
+    {
+        if (e & 1)
+            for (unsigned i = 0; i != count; ++i)
+                out[i] *= base[i];
+        for (unsigned i = 0; i != count; ++i)
+            base[i] *= base[i];
+    }
+}
+
 /**
  * @brief Calculates diffuse and specular lighting
  * @param Material of the shape, point of intersection, normal vector, view vector
  * @returns The color of the pixel the be drawn
  */
 
-Color Scene::getDiffuseAndSpecularLighting(Material material, Point hit, Vector N, Vector V, LightPtr light) {
+Color Scene::getDiffuseAndSpecularLighting(Material const &material, Point const &hit, Vector const &N, Vector const &V, Light const &light) {
     
     Color color(0.0, 0.0, 0.0);
-    Vector L = light->position - hit; 
+    Vector L = light.position - hit; 
     L.normalize();
     Vector R = N * 2 * L.dot(N) - L;
     
     //Diffuse
     
     Color id(0.0,0.0,0.0);
-    double dot = L.dot(N);
-    if(dot > 0) id = dot *  material.color* light->color * material.kd;
+    Real dot = L.dot(N);
+    if(dot > 0) id = dot *  material.color* light.color * material.kd;
     
     //Specular
     
     dot = R.dot(V);    
     Color is(0.0,0.0,0.0);
-    if(dot > 0) is = pow(dot, material.n) * light->color*material.ks;
+    if(dot > 0) {
+        Real specular;
+        powLanes(&dot, &specular, 1, material.n);
+        is = specular * light.color*material.ks;
+    }
     
     color = color + id + is;
     
     return color;
 }
 
+// The same as getDiffuseAndSpecularLighting for count lights at once. Every
+// step is a loop over the batch so the compiler vectorizes across lights.
+void Scene::shadeLights(Material const &material, Point const &hit,
+                        Vector const &N, Vector const &V,
+                        size_t first, unsigned count, LightBatch &batch) const
+{
+    Real const *px = &lights.x[first];
+    Real const *py = &lights.y[first];
+    Real const *pz = &lights.z[first];
+    Real const *cr = &lights.r[first];
+    Real const *cg = &lights.g[first];
+    Real const *cb = &lights.b[first];
+
+    Real diffuse[LightBatch::SIZE];
+    Real reflected[LightBatch::SIZE];   // R.V, the specular base
+    Real base[LightBatch::SIZE];
+    Real specular[LightBatch::SIZE];
+
+    for (unsigned i = 0; i != count; ++i)
+    {
+        Real dx = px[i] - hit.x;
+        Real dy = py[i] - hit.y;
+        Real dz = pz[i] - hit.z;
+        Real invlen = 1.0 / sqrt(dx * dx + dy * dy + dz * dz);
+        Real lx = dx * invlen;
+        Real ly = dy * invlen;
+        Real lz = dz * invlen;
+
+        Real dot = lx * N.x + ly * N.y + lz * N.z;
+        Real rx = N.x * 2 * dot - lx;
+        Real ry = N.y * 2 * dot - ly;
+        Real rz = N.z * 2 * dot - lz;
+        Real rv = rx * V.x + ry * V.y + rz * V.z;
+
+        batch.lx[i] = lx;
+        batch.ly[i] = ly;
+        batch.lz[i] = lz;
+        diffuse[i] = dot > 0 ? dot : 0;
+        reflected[i] = rv;
+        base[i] = rv > 0 ? rv : 0;
+    }
+
+    powLanes(base, specular, count, material.n);
+
+    for (unsigned i = 0; i != count; ++i)
+    {
+        Real s = reflected[i] > 0 ? specular[i] : 0;
+        batch.r[i] = diffuse[i] * material.color.r * cr[i] * material.kd + s * cr[i] * material.ks;
+        batch.g[i] = diffuse[i] * material.color.g * cg[i] * material.kd + s * cg[i] * material.ks;
+        batch.b[i] = diffuse[i] * material.color.b * cb[i] * material.kd + s * cb[i] * material.ks;
+    }
+}
+
 /**
  * @brief Recursively calculates the color of the specular reflection.
  * @param Material of the shape, reflection ray, normal vector, specular coefficient, color of reflection, current depth 
@@ -188,13 +653,14 @@ Color Scene::getDiffuseAndSpecularLighting(Material material, Point hit, Vector
  */
 
 
-Color Scene::getSpecularReflection(Material material, Ray r, Vector N, double ks, Color reflected, int depth) {
-    Hit min_hit(numeric_limits<double>::infinity(), Vector());
+Color Scene::getSpecularReflection(Material material, Ray r, Vector N, Real ks, Color reflected, int depth, Real spread, Real travelled) {
+    Hit min_hit(numeric_limits<Real>::infinity(), Vector());
     
     if(ks == 0.0) return reflected; //Material is not shiny
     if(depth == maxRecursionDepth) return reflected;
     
     ObjectPtr obj = nullptr;
+    unsigned objIdx = 0;
     for (unsigned idx = 0; idx != objects.size(); ++idx)
     {
         Hit h(objects[idx]->intersect(r));
@@ -202,13 +668,21 @@ Color Scene::getSpecularReflection(Material material, Ray r, Vector N, double ks
         {
             min_hit = h;
             obj = objects[idx];
+            objIdx = idx;
         }
     }
+    ++rayCount;
+    testCount += objects.size();
     
     if(!obj) return reflected; //No hit
+    if (contributions)
+        touched.push_back(objIdx);
     Point hitPoint = r.at(min_hit.t);
     
     Material newMaterial = obj->material;
+    travelled += min_hit.t;
+    if (newMaterial.texture)
+        newMaterial.color = textureColor(*obj, hitPoint, min_hit.N, r.D, travelled * spread);
     
     reflected += newMaterial.color * ks;
     
@@ -217,7 +691,7 @@ Color Scene::getSpecularReflection(Material material, Ray r, Vector N, double ks
     Vector V = -r.D;
     Vector R = N * 2 * V.dot(N) -  V; //New reflection vector
     Ray newRay(hitPoint+N*BIAS, R); //New reflection ray
-    return getSpecularReflection(newMaterial, newRay, N, ks * newMaterial.ks, reflected, depth+1 );    
+    return getSpecularReflection(newMaterial, newRay, N, ks * newMaterial.ks, reflected, depth+1, spread, travelled);    
 }
 
 
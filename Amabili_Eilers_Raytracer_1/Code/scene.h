@@ -1,47 +1,174 @@
 #ifndef SCENE_H_
 #define SCENE_H_
 
+#include "arena.h"
 #include "light.h"
+#include "lightcull.h"
 #include "object.h"
 #include "triple.h"
 #include "material.h"
+#include "traversal.h"
 
+#include <cstdint>
+#include <memory>
+#include <utility>
 #include <vector>
 
 // Forward declerations
 class Ray;
 class Image;
+struct AuxBuffers;
+class CostMap;
+class ContributionMap;
+
+// Shadow rays traced over a scene's life
+struct ShadowStats
+{
+    uint64_t rays = 0;
+    uint64_t occluded = 0;      // rays that hit something
+    uint64_t cacheHits = 0;     // answered by the light's last occluder
+};
 
 class Scene
 {
+    // owns the objects, copies of the scene share it
+    std::shared_ptr<Arena> arena = std::make_shared<Arena>();
     std::vector<ObjectPtr> objects;
-    std::vector<LightPtr> lights;   // no ptr needed, but kept for consistency
+    LightArrays lights;
+    bool cullLights = false;
+    LightCulling lightCulling;
+    std::vector<LightCluster> lightClusters;    // built on first use
     Point eye;
-    bool shadows;
-    int maxRecursionDepth;
-    int superSamplingFactor;
+    bool shadows = false;
+    int maxRecursionDepth = 0;
+    int superSamplingFactor = 1;
+    Traversal traversal = Traversal::RowMajor;
+    unsigned tileSize = 16;
+    CostMap *costMap = nullptr;         // per pixel cost, when profiling
+    ContributionMap *contributions = nullptr;   // objects per pixel, when
+    std::vector<uint32_t> touched;              // watching (scratch)
+    std::vector<PixelOffset> const *pixelList = nullptr;  // see render
+    uint64_t rayCount = 0;              // rays traced and intersection
+    uint64_t testCount = 0;             // tests done, over the scene's life
+    std::vector<ObjectPtr> lastOccluder;    // per light, what blocked its
+                                            // last shadow ray
+    ShadowStats shadowStats;
 
     public:
+        static unsigned const MAX_TILE_SIZE = 1024;
 
         // trace a ray into the scene and return the color
         Color trace(Ray const &ray);
-        Color getDiffuseAndSpecularLighting(Material material, Point hit, Vector N, Vector V, LightPtr light);
-        Color getSpecularReflection(Material material, Ray r, Vector N, double ks, Color reflected, int depth);
+        Color getDiffuseAndSpecularLighting(Material const &material, Point const &hit, Vector const &N, Vector const &V, Light const &light);
+        // spread: footprint growth per unit of distance along the path
+        // (for texture filtering), travelled: path length up to r
+        Color getSpecularReflection(Material material, Ray r, Vector N, Real ks, Color reflected, int depth, Real spread = 0.0, Real travelled = 0.0);
 
         // render the scene to the given image
         void render(Image &img);
+        // render part of a frame that is frameHeight pixels high: img
+        // receives the img.width() x img.height() pixels at (x0, y0)
+        void render(Image &img, unsigned x0, unsigned y0, unsigned frameHeight);
+        // render only the listed pixels of the (full frame) img
+        void render(Image &img, std::vector<PixelOffset> const &pixels);
+        // first hit normal, depth and albedo of every pixel, for the
+        // denoiser (aux sized like the frame)
+        void renderAux(AuxBuffers &aux);
 
 
+        // Allocate an object in the scene's arena, it lives as long as
+        // the scene and its copies. Add it to the scene with addObject.
+        template <typename T, typename ...Args>
+        T *createObject(Args &&...args)
+        {
+            return arena->create<T>(std::forward<Args>(args)...);
+        }
+
         void addObject(ObjectPtr obj);
         void addLight(Light const &light);
+        void clearLights();
         void setEye(Triple const &position);
         void setShadows(bool s);
         void setMaxRecursionDepth(int depth);
-        void setSuperSamplingFactor(int factor);
+        void setSuperSamplingFactor(int factor);    // >= 1, throws otherwise
+        // size is the tile width, 1 to MAX_TILE_SIZE (throws otherwise)
+        void setTraversal(Traversal order, unsigned size);
+        // skip lights as configured, this reorders the lights
+        void setLightCulling(LightCulling const &settings);
+        // record what every pixel costs into map (frame coordinates) while
+        // rendering, nullptr to stop
+        void setCostMap(CostMap *map);
+        // record which objects every pixel shows into map (frame
+        // coordinates) while rendering, nullptr to stop
+        void setContributions(ContributionMap *map);
  
         
         unsigned getNumObject();
+        ObjectPtr getObject(unsigned idx);
         unsigned getNumLights();
+        bool getShadows() const;
+        unsigned getTileSize() const;
+        int getSuperSamplingFactor() const;
+        int getMaxRecursionDepth() const;
+        uint64_t getRayCount() const;
+        uint64_t getTestCount() const;
+        ShadowStats getShadowStats() const;
+
+    private:
+
+        // Direction to and diffuse plus specular contribution of up to
+        // SIZE consecutive lights, see shadeLights
+        struct LightBatch
+        {
+            static unsigned const SIZE = 64;
+            Real lx[SIZE], ly[SIZE], lz[SIZE];
+            Real r[SIZE], g[SIZE], b[SIZE];
+        };
+
+        // fill batch with lights [first, first + count) seen from hit
+        void shadeLights(Material const &material, Point const &hit,
+                         Vector const &N, Vector const &V,
+                         size_t first, unsigned count, LightBatch &batch) const;
+
+        // A light that passed culling, its shadow ray still to be traced
+        struct ShadowCandidate
+        {
+            Vector L;
+            Color color;
+            Real strength;
+            size_t light;
+        };
+        std::vector<ShadowCandidate> candidates;    // scratch of culledLighting
+
+        // Diffuse and specular light at hit with lightCulling applied,
+        // shadow rays leave from origin
+        Color culledLighting(Material const &material, Point const &hit,
+                             Vector const &N, Vector const &V,
+                             Point const &origin, bool shadows);
+        // does anything block the shadow ray towards light (counts the ray
+        // and its tests), the light's last occluder is tried first
+        bool occluded(Ray const &ray, size_t light);
+
+        // Render kernels, instantiated for every combination of scene
+        // features so the per ray checks compile away. render() picks one
+        // once per image, SuperSampling == 0 is the generic fallback.
+        template <bool Shadows, bool Reflections>
+        void renderFeatures(Image &img, unsigned x0, unsigned y0,
+                            unsigned frameHeight);
+        template <bool Shadows, bool Reflections, unsigned SuperSampling>
+        void renderKernel(Image &img, unsigned x0, unsigned y0,
+                          unsigned frameHeight);
+        template <bool Shadows, bool Reflections, unsigned SuperSampling>
+        void shadePixel(Image &img, unsigned x, unsigned y,
+                        unsigned x0, unsigned y0, unsigned frameHeight);
+        template <bool Shadows, bool Reflections, unsigned SuperSampling>
+        Color samplePixel(unsigned x, unsigned y, unsigned h);
+        template <bool Shadows, bool Reflections>
+        Color traceKernel(Ray const &ray, Real spread = 0.0);
+
+        // Texture color of obj at hit for a footprint that wide (seen along D)
+        Color textureColor(Object const &obj, Point const &hit, Vector const &N,
+                           Vector const &D, Real footprint) const;
 };
 
 #endif
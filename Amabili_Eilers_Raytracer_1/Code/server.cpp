@@ -0,0 +1,348 @@
+#include "server.h"
+
+#include "watch.h"
+
+#include "json/json.h"
+
+#include "parallel.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+using namespace std;
+using json = nlohmann::json;
+
+namespace
+{
+    int const POLL_MS = 200;            // how often run looks at the flags
+
+    volatile sig_atomic_t g_signalled = 0;
+
+    extern "C" void onSignal(int)
+    {
+        g_signalled = 1;
+    }
+
+    // Swallows the progress messages of requests
+    class Discard: public streambuf
+    {
+        protected:
+            int overflow(int ch) override
+            {
+                return traits_type::not_eof(ch);
+            }
+
+            streamsize xsputn(char const *, streamsize count) override
+            {
+                return count;
+            }
+    };
+
+    Discard g_discard;
+
+    // The checkpoint, cost map and aux buffer files of a render are named
+    // after its output without the extension
+    string stem(string const &output)
+    {
+        return output.substr(0, output.find_last_of('.'));
+    }
+
+    bool sendAll(int fd, string const &data)
+    {
+        size_t sent = 0;
+        while (sent < data.size())
+        {
+            ssize_t count = send(fd, data.data() + sent, data.size() - sent,
+                                 MSG_NOSIGNAL);
+            if (count <= 0)
+                return false;
+            sent += count;
+        }
+        return true;
+    }
+}
+
+RenderServer::RenderServer(string const &socketPath, size_t maxScenes,
+                           unsigned maxConnections)
+:
+    d_socketPath(socketPath),
+    d_maxScenes(maxScenes),
+    d_maxConnections(max(1u, maxConnections)),
+    d_stop(false)
+{}
+
+RenderServer::OutputClaim::OutputClaim(RenderServer &server,
+                                       string const &output)
+:
+    d_server(server),
+    d_stem(stem(output))
+{
+    unique_lock<mutex> lock(d_server.d_stateMutex);
+    d_server.d_changed.wait(lock, [&]()
+    {
+        return d_server.d_outputs.count(d_stem) == 0;
+    });
+    d_server.d_outputs.insert(d_stem);
+}
+
+RenderServer::OutputClaim::~OutputClaim()
+{
+    {
+        lock_guard<mutex> lock(d_server.d_stateMutex);
+        d_server.d_outputs.erase(d_stem);
+    }
+    d_server.d_changed.notify_all();
+}
+
+bool RenderServer::run()
+{
+    sockaddr_un address = sockaddr_un();
+    address.sun_family = AF_UNIX;
+    if (d_socketPath.size() >= sizeof(address.sun_path))
+    {
+        cerr << "Socket path too long: " << d_socketPath << '\n';
+        return false;
+    }
+    strcpy(address.sun_path, d_socketPath.c_str());
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(d_socketPath.c_str());       // left behind by a previous run
+    if (listener < 0
+        || fcntl(listener, F_SETFL, O_NONBLOCK) < 0
+        || bind(listener, reinterpret_cast<sockaddr *>(&address),
+                sizeof(address)) < 0
+        || listen(listener, 16) < 0)
+    {
+        cerr << "Could not listen on " << d_socketPath << ": "
+             << strerror(errno) << '\n';
+        if (listener >= 0)
+            close(listener);
+        return false;
+    }
+
+    // Without SA_RESTART, so a signal also interrupts poll
+    struct sigaction action;
+    memset(&action, 0, sizeof action);
+    action.sa_handler = onSignal;
+    sigemptyset(&action.sa_mask);
+    struct sigaction oldInt;
+    struct sigaction oldTerm;
+    g_signalled = 0;
+    sigaction(SIGINT, &action, &oldInt);
+    sigaction(SIGTERM, &action, &oldTerm);
+
+    cout << "Listening on " << d_socketPath << "...\n";
+    cout.flush();
+
+    bool ok = true;
+    {
+        ThreadPool pool(d_maxConnections);
+        unsigned backoff = 0;           // ms, after running out of files
+        while (!stopping())
+        {
+            // Accept only with a free slot, other clients wait in the
+            // listen queue
+            {
+                unique_lock<mutex> lock(d_stateMutex);
+                if (!d_changed.wait_for(lock, chrono::milliseconds(POLL_MS),
+                        [&]()
+                        {
+                            return d_connections.size() < d_maxConnections
+                                || d_stop;
+                        }))
+                    continue;
+            }
+
+            pollfd ready = { listener, POLLIN, 0 };
+            if (poll(&ready, 1, POLL_MS) <= 0)
+                continue;               // timeout or EINTR: look at the flags
+
+            int fd = accept(listener, nullptr, nullptr);
+            if (fd < 0)
+            {
+                if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK
+                    || errno == ECONNABORTED)
+                    continue;
+                if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS
+                    || errno == ENOMEM)
+                {
+                    // Out of resources: give the open connections time to
+                    // finish instead of spinning on accept
+                    backoff = min(backoff == 0 ? 100 : 2 * backoff, 5000u);
+                    cerr << "accept: " << strerror(errno) << ", retrying in "
+                         << backoff << " ms\n";
+                    this_thread::sleep_for(chrono::milliseconds(backoff));
+                    continue;
+                }
+                cerr << "accept: " << strerror(errno) << '\n';
+                ok = false;
+                break;
+            }
+            backoff = 0;
+
+            {
+                lock_guard<mutex> lock(d_stateMutex);
+                d_connections.insert(fd);
+            }
+            pool.submit([this, fd](unsigned)
+            {
+                serveConnection(fd);
+                {
+                    lock_guard<mutex> lock(d_stateMutex);
+                    d_connections.erase(fd);
+                }
+                d_changed.notify_all();
+                close(fd);
+            });
+        }
+
+        // Wake the connections waiting for a request, the ones rendering
+        // still send their reply; the pool then waits for all of them
+        lock_guard<mutex> lock(d_stateMutex);
+        for (int fd : d_connections)
+            shutdown(fd, SHUT_RD);
+    }
+
+    close(listener);
+    unlink(d_socketPath.c_str());
+    sigaction(SIGINT, &oldInt, nullptr);
+    sigaction(SIGTERM, &oldTerm, nullptr);
+    return ok;
+}
+
+void RenderServer::stop()
+{
+    d_stop = true;
+    d_changed.notify_all();
+}
+
+bool RenderServer::stopping() const
+{
+    return d_stop || g_signalled;
+}
+
+void RenderServer::serveConnection(int fd)
+{
+    string pending;
+    char buffer[4096];
+    ssize_t count;
+    while (!stopping() && (count = recv(fd, buffer, sizeof(buffer), 0)) > 0)
+    {
+        pending.append(buffer, count);
+
+        size_t newline;
+        while ((newline = pending.find('\n')) != string::npos)
+        {
+            string request = pending.substr(0, newline);
+            pending.erase(0, newline + 1);
+            if (request.find_first_not_of(" \t\r") == string::npos)
+                continue;
+            if (!sendAll(fd, handle(request) + '\n'))
+                return;
+        }
+    }
+}
+
+string RenderServer::handle(string const &request)
+try
+{
+    json node = json::parse(request);
+    json command = node["command"];
+    if (command.is_string() && command.get<string>() == "stop")
+    {
+        stop();
+        json reply;
+        reply["status"] = "ok";
+        return reply.dump();
+    }
+    if (!node["scene"].is_string() || !node["output"].is_string())
+        throw runtime_error("request needs \"scene\" and \"output\"");
+
+    auto start = chrono::steady_clock::now();
+
+    bool cached;
+    Raytracer raytracer(*scene(node["scene"].get<string>(), cached));
+    raytracer.applyOverrides(node);
+
+    ostream quiet(&g_discard);
+    raytracer.setMessages(&quiet);
+    string output = node["output"].get<string>();
+    OutputClaim claim(*this, output);
+    raytracer.renderToFile(output);
+
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    json reply;
+    reply["status"] = "ok";
+    reply["cached"] = cached;
+    reply["seconds"] = elapsed.count();
+    return reply.dump();
+}
+catch (exception const &ex)
+{
+    json reply;
+    reply["status"] = "error";
+    reply["message"] = ex.what();
+    return reply.dump();
+}
+
+shared_ptr<Raytracer const> RenderServer::scene(string const &filename,
+                                                bool &cached)
+{
+    // A file written while it is read gets another version, the next
+    // request reads it again
+    pair<int64_t, int64_t> version = fileVersion(filename);
+    if (version.first < 0)
+        throw runtime_error("Could not open " + filename);
+
+    {
+        lock_guard<mutex> lock(d_mutex);
+        for (auto iter = d_cache.begin(); iter != d_cache.end(); ++iter)
+        {
+            if (iter->filename != filename)
+                continue;
+            if (iter->version != version)
+            {
+                d_cache.erase(iter);
+                break;
+            }
+            d_cache.splice(d_cache.begin(), d_cache, iter);
+            cached = true;
+            return d_cache.front().raytracer;
+        }
+    }
+
+    // Parse without the lock, other connections keep rendering
+    auto raytracer = make_shared<Raytracer>();
+    ostream quiet(&g_discard);
+    raytracer->setMessages(&quiet);
+    if (!raytracer->readScene(filename))
+        throw runtime_error("Reading scene from " + filename + " failed");
+    raytracer->setMessages(nullptr);
+
+    lock_guard<mutex> lock(d_mutex);
+    for (auto iter = d_cache.begin(); iter != d_cache.end(); ++iter)
+    {
+        if (iter->filename == filename)
+        {
+            d_cache.erase(iter);        // another connection's copy
+            break;
+        }
+    }
+    d_cache.push_front(CacheEntry{filename, version, raytracer});
+    if (d_cache.size() > d_maxScenes)
+        d_cache.pop_back();
+    cached = false;
+    return raytracer;
+}
@@ -0,0 +1,99 @@
+#ifndef SERVER_H_
+#define SERVER_H_
+
+#include "raytracer.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+
+// Long running render daemon on a local (Unix domain) socket. Parsed scenes
+// stay in memory, keyed by the scene file's path, modification time and
+// size, so a request only pays for tracing and writing the image. At most
+// maxConnections connections are served at a time, on a pool of threads;
+// further clients wait in the socket's listen queue.
+//
+// Protocol: one JSON object per line,
+//     {"scene": "in.json", "output": "out.png",
+//      "Eye": [...], "Lights": [...], "Size": [w, h]}
+// where Eye, Lights and Size are optional overrides in the scene format,
+// or {"command": "stop"} to stop the server. Every request is answered
+// with one line,
+//     {"status": "ok", "cached": true, "seconds": 0.12}
+// or {"status": "error", "message": "..."}.
+//
+// Requests writing to the same output (by its path without extension, so
+// the checkpoint and cost map files are covered too) render one after
+// another. Their progress messages are dropped, only the server's own
+// errors are printed (to stderr).
+//
+// Meshes are loaded when their scene is, a changed OBJ file behind an
+// unchanged scene file is not noticed until the scene is evicted. The
+// scenes share the process's texture cache, a scene's "TextureBudget"
+// does not change its budget.
+class RenderServer
+{
+    struct CacheEntry
+    {
+        std::string filename;
+        std::pair<int64_t, int64_t> version;    // modification time, size
+        std::shared_ptr<Raytracer const> raytracer;
+    };
+
+    // Holds an output while its request renders
+    class OutputClaim
+    {
+        RenderServer &d_server;
+        std::string d_stem;
+
+        public:
+            OutputClaim(RenderServer &server, std::string const &output);
+            ~OutputClaim();
+    };
+
+    std::string d_socketPath;
+    std::mutex d_mutex;                 // guards d_cache
+    std::list<CacheEntry> d_cache;      // most recently used first
+    size_t d_maxScenes;
+    unsigned d_maxConnections;
+
+    std::mutex d_stateMutex;            // guards d_connections, d_outputs
+    std::condition_variable d_changed;  // one of them shrank, or stopping
+    std::set<int> d_connections;        // open sockets
+    std::set<std::string> d_outputs;    // stems being rendered
+    std::atomic<bool> d_stop;
+
+    public:
+        explicit RenderServer(std::string const &socketPath,
+                              size_t maxScenes = 16,
+                              unsigned maxConnections = 8);
+
+        // Serve requests until stop is called, a "stop" command arrives or
+        // the process gets SIGINT or SIGTERM. Requests being rendered are
+        // finished and answered first. Returns false if the socket could
+        // not be set up or failed.
+        bool run();
+
+        // Make run return, thread safe
+        void stop();
+
+        // Handle a single request line and return the reply line, thread
+        // safe
+        std::string handle(std::string const &request);
+
+    private:
+        bool stopping() const;
+        void serveConnection(int fd);
+
+        // The cached raytracer for the scene file, loading it on a miss
+        std::shared_ptr<Raytracer const> scene(std::string const &filename,
+                                               bool &cached);
+};
+
+#endif
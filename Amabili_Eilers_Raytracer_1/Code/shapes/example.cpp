@@ -6,7 +6,7 @@ Hit Example::intersect(Ray const &ray)
 {
     /* Your intersect calculation goes here */
 
-    double t = 0 /* = ... */;
+    Real t = 0 /* = ... */;
     Vector N /* = ... */;
 
     return Hit(t, N);
@@ -1,7 +1,8 @@
 #include "plane.h"
 
+#include "../arena.h"
+
 #include <cmath>
-#define eps 1e-9
 
 using namespace std;
 
@@ -20,12 +21,12 @@ Hit Plane::intersect(Ray const &ray)
     
 
     
-    double d = normal.dot(ray.D);
+    Real d = normal.dot(ray.D);
     
-    if(d < eps) return Hit::NO_HIT(); //Ray is (close to) parallel to the plane
+    if(d < Precision<Real>::parallel()) return Hit::NO_HIT(); //Ray is (close to) parallel to the plane
     
     Vector p = position - ray.O;
-    double t = p.dot(normal) / d;
+    Real t = p.dot(normal) / d;
     
     if(t < 0) return Hit::NO_HIT(); //Ray is behind plane
     
@@ -35,6 +36,18 @@ Hit Plane::intersect(Ray const &ray)
     return Hit(t,N);
 }
 
+ObjectPtr Plane::clone(Arena &arena) const
+{
+    return arena.create<Plane>(*this);
+}
+
+void Plane::transform(Object const &rest, Transform const &t)
+{
+    Plane const &from = static_cast<Plane const &>(rest);
+    position = t.point(from.position);
+    normal = t.vector(from.normal);
+}
+
 Plane::Plane(const Point &pos, const Point &n)
 :
     position(pos),
@@ -13,9 +13,11 @@ class Plane: public Object
         Plane(const Point &pos, const Point &n);
 
         virtual Hit intersect(Ray const &ray);
+        virtual ObjectPtr clone(Arena &arena) const;
+        virtual void transform(Object const &rest, Transform const &t);
 
-        const Point position;
-        const Point normal;
+        Point position;
+        Point normal;
 };
 
 #endif
\ No newline at end of file
@@ -5,10 +5,10 @@
 
 using namespace std;
 
-bool Solvers::quadratic(double a, double b, double c,
-                   double &x0, double &x1)
+bool Solvers::quadratic(Real a, Real b, Real c,
+                   Real &x0, Real &x1)
 {
-    double discr = b * b - 4 * a * c;
+    Real discr = b * b - 4 * a * c;
 
     if (discr < 0)
         return false;   // no solution
@@ -19,7 +19,7 @@ bool Solvers::quadratic(double a, double b, double c,
     }
     else
     {
-        double q = (b > 0) ?
+        Real q = (b > 0) ?
                 -0.5 * (b + sqrt(discr)):
                 -0.5 * (b - sqrt(discr));
         x0 = q / a;
@@ -1,6 +1,8 @@
 #include "sphere.h"
 #include "solvers.h"
 
+#include "../arena.h"
+
 #include <cmath>
 
 using namespace std;
@@ -11,12 +13,12 @@ Hit Sphere::intersect(Ray const &ray)
     // Line formula:   x = ray.O + t * ray.D
 
     Vector L = ray.O - position;
-    double a = ray.D.dot(ray.D);
-    double b = 2 * ray.D.dot(L);
-    double c = L.dot(L) - r * r;
+    Real a = ray.D.dot(ray.D);
+    Real b = 2 * ray.D.dot(L);
+    Real c = L.dot(L) - r * r;
 
-    double t0;
-    double t1;
+    Real t0;
+    Real t1;
     if (not Solvers::quadratic(a, b, c, t0, t1))
         return Hit::NO_HIT();
 
@@ -39,8 +41,46 @@ Hit Sphere::intersect(Ray const &ray)
     return Hit(t0, N);
 }
 
-Sphere::Sphere(Point const &pos, double radius)
+TexCoord Sphere::map(Point const &hit, Real footprint) const
+{
+    Vector p = (hit - position) / r;
+    Real x = p.dot(d_a);
+    Real y = p.dot(d_b);
+    Real z = max(Real(-1.0), min(Real(1.0), p.dot(d_w)));
+
+    Real u = (atan2(y, x) + d_angle) / (2.0 * M_PI);
+    u -= floor(u);
+    Real v = acos(z) / M_PI;
+
+    // one uv unit spans pi * r vertically (and 2 pi r at the equator)
+    return TexCoord{u, v, Real(footprint / (M_PI * r))};
+}
+
+ObjectPtr Sphere::clone(Arena &arena) const
+{
+    return arena.create<Sphere>(*this);
+}
+
+void Sphere::transform(Object const &rest, Transform const &t)
+{
+    // the texture turns along
+    Sphere const &from = static_cast<Sphere const &>(rest);
+    position = t.point(from.position);
+    d_a = t.vector(from.d_a);
+    d_b = t.vector(from.d_b);
+    d_w = t.vector(from.d_w);
+}
+
+Sphere::Sphere(Point const &pos, Real radius, Vector const &pole, Real angle)
 :
     position(pos),
-    r(radius)
-{}
+    r(radius),
+    d_w(pole.normalized()),
+    d_angle(angle * M_PI / 180.0)
+{
+    // any vector not parallel to the pole gives the u = 0 meridian
+    Vector reference = fabs(d_w.x) < 0.9 ? Vector(1.0, 0.0, 0.0)
+                                         : Vector(0.0, 1.0, 0.0);
+    d_a = reference.cross(d_w).normalized();
+    d_b = d_w.cross(d_a);
+}
@@ -6,12 +6,25 @@
 class Sphere: public Object
 {
     public:
-        Sphere(Point const &pos, double radius);
+        // The texture's north pole points along pole, angle (degrees)
+        // turns it around that axis
+        Sphere(Point const &pos, Real radius,
+               Vector const &pole = Vector(0.0, 1.0, 0.0), Real angle = 0.0);
 
         virtual Hit intersect(Ray const &ray);
+        virtual TexCoord map(Point const &hit, Real footprint) const;
+        virtual ObjectPtr clone(Arena &arena) const;
+        virtual void transform(Object const &rest, Transform const &t);
 
-        Point const position;
-        double const r;
+        Point position;
+        Real const r;
+
+    private:
+        // texture frame: w towards the pole, u = 0 along a
+        Vector d_a;
+        Vector d_b;
+        Vector d_w;
+        Real d_angle;           // radians
 };
 
 #endif
@@ -1,32 +1,36 @@
 #include "triangle.h"
 
-#include <cfloat>   // DBL_EPSILON
+#include "../arena.h"
+
 #include <cmath>
 
+// tolerance follows the precision the pipeline is built with
+static Real const EPSILON = Precision<Real>::epsilon();
+
 Hit Triangle::intersect(Ray const &ray)
 {
     // Möller-Trumbore
     Vector edge1(v1 - v0);
     Vector edge2(v2 - v0);
     Vector h = ray.D.cross(edge2);
-    double a = edge1.dot(h);
-    if (a > -DBL_EPSILON && a < DBL_EPSILON)
+    Real a = edge1.dot(h);
+    if (a > -EPSILON && a < EPSILON)
         return Hit::NO_HIT();
 
-    double f = 1 / a;
+    Real f = 1 / a;
     Vector s = ray.O - v0;
-    double u = f * s.dot(h);
+    Real u = f * s.dot(h);
     if (u < 0.0 || u > 1.0)
         return Hit::NO_HIT();
 
     Vector q = s.cross(edge1);
-    double v = f * ray.D.dot(q);
+    Real v = f * ray.D.dot(q);
     if (v < 0.0 || u + v > 1.0)
         return Hit::NO_HIT();
 
-    double t = f * edge2.dot(q);
+    Real t = f * edge2.dot(q);
 
-    if (t <= DBL_EPSILON)    // line intersection (not ray)
+    if (t <= EPSILON)    // line intersection (not ray)
         return Hit::NO_HIT();
 
     // determine orientation of the normal
@@ -37,6 +41,20 @@ Hit Triangle::intersect(Ray const &ray)
     return Hit(t, normal);
 }
 
+ObjectPtr Triangle::clone(Arena &arena) const
+{
+    return arena.create<Triangle>(*this);
+}
+
+void Triangle::transform(Object const &rest, Transform const &t)
+{
+    Triangle const &from = static_cast<Triangle const &>(rest);
+    v0 = t.point(from.v0);
+    v1 = t.point(from.v1);
+    v2 = t.point(from.v2);
+    N = t.vector(from.N);
+}
+
 Triangle::Triangle(Point const &v0,
          Point const &v1,
          Point const &v2)
@@ -11,6 +11,8 @@ class Triangle: public Object
                  Point const &v2);
 
         virtual Hit intersect(Ray const &ray);
+        virtual ObjectPtr clone(Arena &arena) const;
+        virtual void transform(Object const &rest, Transform const &t);
 
         Point v0;
         Point v1;
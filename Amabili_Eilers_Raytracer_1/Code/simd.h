@@ -0,0 +1,204 @@
+#ifndef SIMD_H_
+#define SIMD_H_
+
+// Element wise kernels on the lanes of a Triple (see triple.h). The generic
+// version is a plain loop the compiler can unroll. With the padded 4 lane
+// layout (configure with -DRAY_PADDED_TRIPLE=ON) a Triple fills a whole
+// SSE/NEON register (float) or AVX register (double), and the kernels
+// below map directly onto those intrinsics.
+//
+// Unaligned loads are used throughout: pre C++17 operator new only
+// guarantees 16 byte alignment, so a padded double Triple is not over-aligned
+// and AVX operands may straddle a cache line.
+
+#include <cstddef>
+
+#ifdef RAY_PADDED_TRIPLE
+#define TRIPLE_LANES 4
+#else
+#define TRIPLE_LANES 3
+#endif
+
+// Alignment of a Triple of T: a whole register when new can provide it
+template <typename T>
+constexpr std::size_t tripleAlignment()
+{
+    return TRIPLE_LANES == 4 && 4 * sizeof(T) <= 16 ? 4 * sizeof(T)
+                                                    : alignof(T);
+}
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+template <typename T, unsigned N>
+struct Lanes
+{
+    static void add(T *out, T const *a, T const *b)
+    {
+        for (unsigned i = 0; i != N; ++i)
+            out[i] = a[i] + b[i];
+    }
+
+    static void sub(T *out, T const *a, T const *b)
+    {
+        for (unsigned i = 0; i != N; ++i)
+            out[i] = a[i] - b[i];
+    }
+
+    static void mul(T *out, T const *a, T const *b)
+    {
+        for (unsigned i = 0; i != N; ++i)
+            out[i] = a[i] * b[i];
+    }
+
+    static void scale(T *out, T const *a, T f)      // a * f
+    {
+        for (unsigned i = 0; i != N; ++i)
+            out[i] = a[i] * f;
+    }
+
+    static void offset(T *out, T const *a, T f)     // a + f
+    {
+        for (unsigned i = 0; i != N; ++i)
+            out[i] = a[i] + f;
+    }
+
+    static void neg(T *out, T const *a)
+    {
+        for (unsigned i = 0; i != N; ++i)
+            out[i] = -a[i];
+    }
+};
+
+// --- x86 ---------------------------------------------------------------------
+
+#if defined(__SSE2__)
+
+template <>
+struct Lanes<float, 4>
+{
+    static void add(float *out, float const *a, float const *b)
+    {
+        _mm_storeu_ps(out, _mm_add_ps(_mm_loadu_ps(a), _mm_loadu_ps(b)));
+    }
+
+    static void sub(float *out, float const *a, float const *b)
+    {
+        _mm_storeu_ps(out, _mm_sub_ps(_mm_loadu_ps(a), _mm_loadu_ps(b)));
+    }
+
+    static void mul(float *out, float const *a, float const *b)
+    {
+        _mm_storeu_ps(out, _mm_mul_ps(_mm_loadu_ps(a), _mm_loadu_ps(b)));
+    }
+
+    static void scale(float *out, float const *a, float f)
+    {
+        _mm_storeu_ps(out, _mm_mul_ps(_mm_loadu_ps(a), _mm_set1_ps(f)));
+    }
+
+    static void offset(float *out, float const *a, float f)
+    {
+        _mm_storeu_ps(out, _mm_add_ps(_mm_loadu_ps(a), _mm_set1_ps(f)));
+    }
+
+    static void neg(float *out, float const *a)
+    {
+        _mm_storeu_ps(out, _mm_xor_ps(_mm_loadu_ps(a), _mm_set1_ps(-0.0f)));
+    }
+};
+
+#endif
+
+#if defined(__AVX__)
+
+template <>
+struct Lanes<double, 4>
+{
+    static void add(double *out, double const *a, double const *b)
+    {
+        _mm256_storeu_pd(out,
+            _mm256_add_pd(_mm256_loadu_pd(a), _mm256_loadu_pd(b)));
+    }
+
+    static void sub(double *out, double const *a, double const *b)
+    {
+        _mm256_storeu_pd(out,
+            _mm256_sub_pd(_mm256_loadu_pd(a), _mm256_loadu_pd(b)));
+    }
+
+    static void mul(double *out, double const *a, double const *b)
+    {
+        _mm256_storeu_pd(out,
+            _mm256_mul_pd(_mm256_loadu_pd(a), _mm256_loadu_pd(b)));
+    }
+
+    static void scale(double *out, double const *a, double f)
+    {
+        _mm256_storeu_pd(out,
+            _mm256_mul_pd(_mm256_loadu_pd(a), _mm256_set1_pd(f)));
+    }
+
+    static void offset(double *out, double const *a, double f)
+    {
+        _mm256_storeu_pd(out,
+            _mm256_add_pd(_mm256_loadu_pd(a), _mm256_set1_pd(f)));
+    }
+
+    static void neg(double *out, double const *a)
+    {
+        _mm256_storeu_pd(out,
+            _mm256_xor_pd(_mm256_loadu_pd(a), _mm256_set1_pd(-0.0)));
+    }
+};
+
+#endif
+
+// --- ARM ---------------------------------------------------------------------
+
+#if defined(__ARM_NEON)
+
+template <>
+struct Lanes<float, 4>
+{
+    static void add(float *out, float const *a, float const *b)
+    {
+        vst1q_f32(out, vaddq_f32(vld1q_f32(a), vld1q_f32(b)));
+    }
+
+    static void sub(float *out, float const *a, float const *b)
+    {
+        vst1q_f32(out, vsubq_f32(vld1q_f32(a), vld1q_f32(b)));
+    }
+
+    static void mul(float *out, float const *a, float const *b)
+    {
+        vst1q_f32(out, vmulq_f32(vld1q_f32(a), vld1q_f32(b)));
+    }
+
+    static void scale(float *out, float const *a, float f)
+    {
+        vst1q_f32(out, vmulq_n_f32(vld1q_f32(a), f));
+    }
+
+    static void offset(float *out, float const *a, float f)
+    {
+        vst1q_f32(out, vaddq_f32(vld1q_f32(a), vdupq_n_f32(f)));
+    }
+
+    static void neg(float *out, float const *a)
+    {
+        vst1q_f32(out, vnegq_f32(vld1q_f32(a)));
+    }
+};
+
+#endif
+
+#endif
@@ -0,0 +1,471 @@
+#include "texture.h"
+
+#include "image.h"
+#include "lode/lodepng.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace
+{
+    unsigned const TILE_SHIFT = 6;      // 64x64 texels per cache tile
+    unsigned const TILE = 1 << TILE_SHIFT;
+    size_t const TILE_BYTES = TILE * TILE * sizeof(uint32_t);
+
+    // Position of (x, y) within its tile: 8x8 sub-tiles in row order
+    unsigned texelIndex(unsigned x, unsigned y)
+    {
+        x &= TILE - 1;
+        y &= TILE - 1;
+        return ((y >> 3) * (TILE / 8) + (x >> 3)) * 64 + (y & 7) * 8 + (x & 7);
+    }
+
+    uint32_t pack(Color const &c)
+    {
+        auto byte = [](Real value)
+        {
+            return static_cast<uint32_t>(
+                min(max(value, Real(0.0)), Real(1.0)) * 255.0 + 0.5);
+        };
+        return byte(c.r) | byte(c.g) << 8 | byte(c.b) << 16 | 0xff000000u;
+    }
+
+    Color unpack(uint32_t texel)
+    {
+        return Color(texel & 0xff, texel >> 8 & 0xff, texel >> 16 & 0xff) / 255.0;
+    }
+
+    int wrap(int value, int size)
+    {
+        value %= size;
+        return value < 0 ? value + size : value;
+    }
+
+    // The tiles a thread sampled last, direct mapped. Textures live as long
+    // as the process, so (texture, level, index) never names another tile.
+    struct Handle
+    {
+        Texture const *texture = nullptr;
+        unsigned level = 0;
+        size_t index = 0;
+        TexTile texels;
+    };
+
+    unsigned const HANDLES = 16;
+    thread_local Handle t_handles[HANDLES];
+
+    Handle &handle(Texture const *texture, unsigned level, size_t index)
+    {
+        uint32_t key = (uint32_t(index) * 31 + level)
+                     ^ uint32_t(reinterpret_cast<uintptr_t>(texture) >> 6);
+        return t_handles[key * 0x9e3779b1u >> 28];
+    }
+
+    // Half the size of a level (clamped at odd edges), each texel averages
+    // 2x2 of source
+    template <typename Source>
+    vector<Color> halve(Source const &source, unsigned width, unsigned height,
+                        unsigned nextWidth, unsigned nextHeight)
+    {
+        vector<Color> next(size_t(nextWidth) * nextHeight);
+        for (unsigned y = 0; y != nextHeight; ++y)
+        {
+            unsigned ya = min(2 * y, height - 1);
+            unsigned yb = min(2 * y + 1, height - 1);
+            for (unsigned x = 0; x != nextWidth; ++x)
+            {
+                unsigned xa = min(2 * x, width - 1);
+                unsigned xb = min(2 * x + 1, width - 1);
+                next[size_t(y) * nextWidth + x] =
+                    (source(xa, ya) + source(xb, ya)
+                   + source(xa, yb) + source(xb, yb)) * 0.25;
+            }
+        }
+        return next;
+    }
+}
+
+// --- Texture -----------------------------------------------------------------
+
+Texture::Texture(string const &filename, TextureCache &cache)
+:
+    d_filename(filename),
+    d_cache(cache)
+{
+    // The header is enough to lay out the mip levels
+    unsigned char header[33];
+    ifstream in(filename, ios::binary);
+    if (!in.read(reinterpret_cast<char *>(header), sizeof(header)))
+        throw runtime_error("Could not read texture " + filename);
+
+    unsigned width;
+    unsigned height;
+    LodePNGState state;
+    lodepng_state_init(&state);
+    unsigned error = lodepng_inspect(&width, &height, &state, header,
+                                     sizeof(header));
+    lodepng_state_cleanup(&state);
+    if (error || width == 0 || height == 0)
+        throw runtime_error(filename + " is not a PNG texture");
+
+    while (true)
+    {
+        Level level;
+        level.width = width;
+        level.height = height;
+        level.tilesX = (width + TILE - 1) / TILE;
+        size_t tiles = size_t(level.tilesX) * ((height + TILE - 1) / TILE);
+        level.tiles.assign(tiles, -1);
+        level.used.reset(new atomic<bool>[tiles]());
+        d_levels.push_back(move(level));
+
+        if (width == 1 && height == 1)
+            break;
+        width = max(width / 2, 1u);
+        height = max(height / 2, 1u);
+    }
+}
+
+unsigned Texture::width() const
+{
+    return d_levels.front().width;
+}
+
+unsigned Texture::height() const
+{
+    return d_levels.front().height;
+}
+
+unsigned Texture::levels() const
+{
+    return d_levels.size();
+}
+
+Color Texture::sample(Real u, Real v, Real footprint)
+{
+    // the level where one texel covers the footprint
+    Real lod = footprint * max(width(), height());
+    lod = lod > 1.0 ? log2(lod) : 0.0;
+
+    unsigned last = d_levels.size() - 1;
+    if (lod >= last)
+        return bilinear(last, u, v);
+
+    unsigned fine = static_cast<unsigned>(lod);
+    Real frac = lod - fine;
+    Color color = bilinear(fine, u, v);
+    if (frac > 0.0)
+        color = color * (1.0 - frac) + bilinear(fine + 1, u, v) * frac;
+    return color;
+}
+
+Color Texture::texel(unsigned level, int x, int y)
+{
+    Level const &lvl = d_levels[level];
+    x = wrap(x, lvl.width);
+    y = wrap(y, lvl.height);
+    size_t index = size_t(y >> TILE_SHIFT) * lvl.tilesX + (x >> TILE_SHIFT);
+    return unpack(tile(level, index)[texelIndex(x, y)]);
+}
+
+uint32_t const *Texture::tile(unsigned level, size_t index)
+{
+    Handle &held = handle(this, level, index);
+    if (held.texture == this && held.level == level && held.index == index)
+    {
+        // only write the flag when it changes, it shares a cache line
+        // with the flags of other tiles
+        atomic<bool> &used = d_levels[level].used[index];
+        if (!used.load(memory_order_relaxed))
+            used.store(true, memory_order_relaxed);
+        return held.texels->data();
+    }
+
+    held.texels = d_cache.tile(*this, level, index);
+    held.texture = this;
+    held.level = level;
+    held.index = index;
+    return held.texels->data();
+}
+
+Color Texture::bilinear(unsigned level, Real u, Real v)
+{
+    Level const &lvl = d_levels[level];
+    Real s = u * lvl.width - 0.5;
+    Real t = v * lvl.height - 0.5;
+    Real sFloor = floor(s);
+    Real tFloor = floor(t);
+    Real fs = s - sFloor;
+    Real ft = t - tFloor;
+
+    // wrap here as well, so huge coordinates keep their precision
+    int x = wrap(static_cast<int>(fmod(sFloor, lvl.width)), lvl.width);
+    int y = wrap(static_cast<int>(fmod(tFloor, lvl.height)), lvl.height);
+
+    Color top = texel(level, x, y) * (1.0 - fs) + texel(level, x + 1, y) * fs;
+    Color bottom = texel(level, x, y + 1) * (1.0 - fs)
+                 + texel(level, x + 1, y + 1) * fs;
+    return top * (1.0 - ft) + bottom * ft;
+}
+
+TexTile Texture::decode(unsigned level, size_t index)
+{
+    // Cut the levels sampled so far, down to the coarsest of them: the
+    // file has to be decoded whole, but levels nobody samples are skipped
+    d_levels[level].sampled = true;
+    unsigned coarsest = 0;
+    for (unsigned idx = 0; idx != d_levels.size(); ++idx)
+        if (d_levels[idx].sampled)
+            coarsest = idx;
+
+    // Scratch: the decoded file and, below level 0, two levels of Colors
+    size_t pixels = size_t(width()) * height();
+    size_t scratch = pixels * 4;
+    if (coarsest != 0)
+        scratch += (pixels / 4 + pixels / 16) * sizeof(Color);
+    d_cache.reserve(*this, scratch);
+
+    vector<unsigned char> rgba;
+    unsigned width;
+    unsigned height;
+    unsigned error = lodepng::decode(rgba, width, height, d_filename);
+    if (error)
+        throw runtime_error(d_filename + ": " + lodepng_error_text(error));
+    if (width != this->width() || height != this->height())
+        throw runtime_error(d_filename + " changed since it was loaded");
+    ++d_cache.d_stats.decodes;
+
+    // The requested level goes in last so the others are evicted first
+    vector<pair<size_t, TexTile>> last;
+
+    // Level 0 comes from the file, each further level averages 2x2 texels
+    // of the one before
+    auto file = [&](unsigned x, unsigned y)
+    {
+        unsigned char const *texel = &rgba[(size_t(y) * width + x) * 4];
+        return Color(texel[0] / 255.0, texel[1] / 255.0, texel[2] / 255.0);
+    };
+    cut(0, file, level, last);
+
+    vector<Color> colors;
+    for (unsigned idx = 1; idx <= coarsest; ++idx)
+    {
+        unsigned nextWidth = d_levels[idx].width;
+        unsigned nextHeight = d_levels[idx].height;
+        if (idx == 1)
+        {
+            colors = halve(file, width, height, nextWidth, nextHeight);
+            vector<unsigned char>().swap(rgba);
+        }
+        else
+        {
+            auto previous = [&](unsigned x, unsigned y)
+            {
+                return colors[size_t(y) * width + x];
+            };
+            colors = halve(previous, width, height, nextWidth, nextHeight);
+        }
+        width = nextWidth;
+        height = nextHeight;
+
+        auto current = [&](unsigned x, unsigned y)
+        {
+            return colors[size_t(y) * width + x];
+        };
+        cut(idx, current, level, last);
+    }
+    vector<unsigned char>().swap(rgba);
+    vector<Color>().swap(colors);
+
+    // and the requested tile last of all
+    for (auto &tile : last)
+        if (tile.first == index)
+            swap(tile, last.back());
+    for (auto const &tile : last)
+    {
+        d_cache.insert(*this, level, tile.first, tile.second);
+        d_cache.evict();
+    }
+    return last.back().second;
+}
+
+template <typename Source>
+void Texture::cut(unsigned level, Source const &source, unsigned requested,
+                  vector<pair<size_t, TexTile>> &last)
+{
+    Level const &lvl = d_levels[level];
+    if (!lvl.sampled)
+        return;
+
+    for (size_t index = 0; index != lvl.tiles.size(); ++index)
+    {
+        if (lvl.tiles[index] >= 0)
+            continue;                   // still resident
+
+        unsigned x0 = (index % lvl.tilesX) * TILE;
+        unsigned y0 = (index / lvl.tilesX) * TILE;
+        auto texels = make_shared<vector<uint32_t>>(TILE * TILE, 0);
+        for (unsigned y = y0; y != min(y0 + TILE, lvl.height); ++y)
+            for (unsigned x = x0; x != min(x0 + TILE, lvl.width); ++x)
+                (*texels)[texelIndex(x, y)] = pack(source(x, y));
+
+        if (level == requested)
+            last.emplace_back(index, move(texels));
+        else
+        {
+            d_cache.insert(*this, level, index, move(texels));
+            d_cache.evict();
+        }
+    }
+}
+
+// --- TextureCache ------------------------------------------------------------
+
+TextureCache &TextureCache::instance()
+{
+    static TextureCache cache;
+    return cache;
+}
+
+Texture *TextureCache::get(string const &filename)
+{
+    lock_guard<mutex> lock(d_mutex);
+
+    auto iter = d_textures.find(filename);
+    if (iter != d_textures.end())
+        return iter->second.get();
+
+    unique_ptr<Texture> texture(new Texture(filename, *this));
+    Texture *result = texture.get();
+    d_textures.emplace(filename, move(texture));
+    return result;
+}
+
+void TextureCache::setBudget(size_t bytes)
+{
+    lock_guard<mutex> lock(d_mutex);
+    d_budget = max(bytes, TILE_BYTES);
+    d_stats.budgetBytes = d_budget;
+    evict();
+}
+
+TextureStats TextureCache::stats()
+{
+    lock_guard<mutex> lock(d_mutex);
+    d_stats.budgetBytes = d_budget;
+    return d_stats;
+}
+
+TexTile TextureCache::tile(Texture &texture, unsigned level, size_t index)
+{
+    lock_guard<mutex> lock(d_mutex);
+
+    int entry = texture.d_levels[level].tiles[index];
+    if (entry >= 0)
+    {
+        ++d_stats.hits;
+        if (entry != d_front)
+        {
+            unlink(entry);
+            pushFront(entry);
+        }
+        return d_entries[entry].texels;
+    }
+
+    ++d_stats.misses;
+    return texture.decode(level, index);
+}
+
+void TextureCache::insert(Texture &texture, unsigned level, size_t index,
+                          TexTile const &texels)
+{
+    int entry;
+    if (d_free.empty())
+    {
+        entry = d_entries.size();
+        d_entries.push_back(Entry());
+    }
+    else
+    {
+        entry = d_free.back();
+        d_free.pop_back();
+    }
+
+    d_entries[entry] = Entry{&texture, level, index, -1, -1, texels};
+    pushFront(entry);
+    texture.d_levels[level].tiles[index] = entry;
+    texture.d_levels[level].used[index].store(false, memory_order_relaxed);
+    d_stats.residentBytes += TILE_BYTES;
+}
+
+void TextureCache::reserve(Texture const &texture, size_t scratch)
+{
+    // least recently used first, skipping the tiles the decode rebuilds
+    int entry = d_back;
+    while (entry >= 0 && d_stats.residentBytes + scratch > d_budget)
+    {
+        Entry &victim = d_entries[entry];
+        int prev = victim.prev;
+        if (victim.texture != &texture
+            || !texture.d_levels[victim.level].sampled)
+            drop(entry);
+        entry = prev;
+    }
+}
+
+void TextureCache::evict()
+{
+    // one second chance per tile, threads may keep setting the flags
+    size_t chances = d_stats.residentBytes / TILE_BYTES;
+    while (d_stats.residentBytes > d_budget && d_front != d_back)
+    {
+        int entry = d_back;
+        Entry const &victim = d_entries[entry];
+        atomic<bool> &used =
+            victim.texture->d_levels[victim.level].used[victim.tile];
+        if (used.exchange(false, memory_order_relaxed) && chances != 0)
+        {
+            --chances;                  // sampled through a handle
+            unlink(entry);
+            pushFront(entry);
+        }
+        else
+            drop(entry);
+    }
+}
+
+void TextureCache::drop(int entry)
+{
+    Entry &victim = d_entries[entry];
+    victim.texture->d_levels[victim.level].tiles[victim.tile] = -1;
+    unlink(entry);
+    victim.texels.reset();
+    d_free.push_back(entry);
+    d_stats.residentBytes -= TILE_BYTES;
+    ++d_stats.evictions;
+}
+
+void TextureCache::unlink(int entry)
+{
+    Entry &e = d_entries[entry];
+    (e.prev >= 0 ? d_entries[e.prev].next : d_front) = e.next;
+    (e.next >= 0 ? d_entries[e.next].prev : d_back) = e.prev;
+    e.prev = e.next = -1;
+}
+
+void TextureCache::pushFront(int entry)
+{
+    Entry &e = d_entries[entry];
+    e.prev = -1;
+    e.next = d_front;
+    if (d_front >= 0)
+        d_entries[d_front].prev = entry;
+    d_front = entry;
+    if (d_back < 0)
+        d_back = entry;
+}
@@ -0,0 +1,145 @@
+#ifndef TEXTURE_H_
+#define TEXTURE_H_
+
+#include "triple.h"
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+class TextureCache;
+
+// 64x64 texels of 8 bit RGBA (16 KiB), laid out in 8x8 sub-tiles so a
+// bilinear lookup stays within a few cache lines. Immutable once built.
+typedef std::shared_ptr<std::vector<uint32_t> const> TexTile;
+
+// A mip mapped texture, decoded on demand. Creating one only reads the PNG
+// header; a sample that needs a tile decodes the file and cuts the mip
+// levels sampled so far into tiles. The tiles live in the TextureCache,
+// which evicts the least recently used ones to stay within its budget; an
+// evicted tile is rebuilt by decoding the file again.
+//
+// Every thread keeps handles to the last few tiles it sampled (at most 16,
+// 256 KiB) and reads those without locking. A handle keeps its tile alive
+// after the cache evicted it.
+class Texture
+{
+    friend class TextureCache;
+
+    struct Level
+    {
+        unsigned width;
+        unsigned height;
+        unsigned tilesX;                // tiles per row
+        bool sampled = false;           // decodes cut this level
+        std::vector<int> tiles;         // cache entries, -1 when evicted
+        // set when a thread samples the tile through its handle, the
+        // cache clears it when giving the tile a second chance
+        std::unique_ptr<std::atomic<bool>[]> used;
+    };
+
+    std::string d_filename;
+    TextureCache &d_cache;
+    std::vector<Level> d_levels;        // full size first, down to 1x1
+
+    public:
+        Texture(std::string const &filename, TextureCache &cache);
+
+        unsigned width() const;
+        unsigned height() const;
+        unsigned levels() const;
+
+        // Trilinear lookup at (u, v), wrapping both ways (v = 0 is the top
+        // row). footprint is the size of the sampled area in uv units, it
+        // picks the mip levels.
+        Color sample(Real u, Real v, Real footprint);
+
+    private:
+        Color texel(unsigned level, int x, int y);
+        Color bilinear(unsigned level, Real u, Real v);
+        // the texels of a tile, from the thread's handles or the cache
+        uint32_t const *tile(unsigned level, size_t index);
+
+        // Decode the file and make the tiles of every sampled level
+        // resident, those of level last, and return the tile at index;
+        // runs with the cache locked
+        TexTile decode(unsigned level, size_t index);
+        template <typename Source>
+        void cut(unsigned level, Source const &source,
+                 unsigned requested, std::vector<std::pair<size_t, TexTile>> &last);
+};
+
+struct TextureStats
+{
+    uint64_t hits;                      // lookups past the thread's handles
+    uint64_t misses;                    // that found the tile resident, or
+                                        // had to decode
+    uint64_t decodes;                   // PNG files decoded
+    uint64_t evictions;                 // tiles dropped for the budget
+    size_t residentBytes;
+    size_t budgetBytes;
+};
+
+// Textures shared by all scenes of the process, plus the LRU cache of their
+// decoded tiles. Thread safe; only lookups that miss a thread's handles
+// lock it.
+class TextureCache
+{
+    friend class Texture;
+
+    // A resident tile, linked into the LRU list by entry index
+    struct Entry
+    {
+        Texture *texture;
+        unsigned level;
+        size_t tile;
+        int prev;                       // more recently used, -1 at front
+        int next;
+        TexTile texels;
+    };
+
+    std::mutex d_mutex;
+    std::map<std::string, std::unique_ptr<Texture>> d_textures;
+    std::vector<Entry> d_entries;
+    std::vector<int> d_free;            // unused entries
+    int d_front = -1;                   // most recently used
+    int d_back = -1;
+    size_t d_budget = size_t(256) << 20;
+    TextureStats d_stats = TextureStats();
+
+    public:
+        static TextureCache &instance();
+
+        // The texture in filename, only its header is read. The pointer
+        // stays valid for the life of the process. Throws runtime_error if
+        // the file is not a readable PNG.
+        Texture *get(std::string const &filename);
+
+        // Bytes of decoded tiles to keep, at least one tile
+        void setBudget(size_t bytes);
+        TextureStats stats();
+
+    private:
+        // Look up a tile, decoding its texture on a miss
+        TexTile tile(Texture &texture, unsigned level, size_t index);
+        // the following run with d_mutex held
+        void insert(Texture &texture, unsigned level, size_t index,
+                    TexTile const &texels);
+        // Make room for the scratch bytes of decoding texture, except for
+        // the tiles the decode rebuilds (so a file larger than the budget
+        // still goes over it while decoding)
+        void reserve(Texture const &texture, size_t scratch);
+        // Trim to the budget, keeping the most recent tile. Tiles sampled
+        // through handles since they reached the back get a second chance.
+        void evict();
+        void drop(int entry);
+        void unlink(int entry);
+        void pushFront(int entry);
+};
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef TRANSFORM_H_
+#define TRANSFORM_H_
+
+#include "triple.h"
+
+#include <cmath>
+
+// Rigid motion: turn by angle (radians) around the axis through pivot, then
+// move by translate. Shapes apply it to a copy of their rest pose (see
+// Object).
+class Transform
+{
+    public:
+        Vector axis;            // unit length
+        Real angle;
+        Point pivot;
+        Vector translate;
+
+        explicit Transform(Vector const &axis = Vector(0.0, 1.0, 0.0),
+                           Real angle = 0.0, Point const &pivot = Point(),
+                           Vector const &translate = Vector())
+        :
+            axis(axis.normalized()),
+            angle(angle),
+            pivot(pivot),
+            translate(translate)
+        {}
+
+        // directions and normals only turn
+        Vector vector(Vector const &v) const
+        {
+            // Rodrigues' rotation formula
+            Real c = std::cos(angle);
+            Real s = std::sin(angle);
+            return v * c + axis.cross(v) * s + axis * (axis.dot(v) * (1 - c));
+        }
+
+        Point point(Point const &p) const
+        {
+            return vector(p - pivot) + pivot + translate;
+        }
+};
+
+#endif
@@ -0,0 +1,89 @@
+#include "traversal.h"
+
+#include <stdexcept>
+#include <utility>
+
+using namespace std;
+
+Traversal parseTraversal(string const &name)
+{
+    if (name == "rowmajor")
+        return Traversal::RowMajor;
+    if (name == "morton")
+        return Traversal::Morton;
+    if (name == "hilbert")
+        return Traversal::Hilbert;
+    throw runtime_error("Unknown traversal order: " + name);
+}
+
+namespace
+{
+    // Take every other bit of d, i.e. undo the bit interleaving of Morton
+    unsigned compactBits(unsigned d)
+    {
+        d &= 0x55555555;
+        d = (d | (d >> 1)) & 0x33333333;
+        d = (d | (d >> 2)) & 0x0f0f0f0f;
+        d = (d | (d >> 4)) & 0x00ff00ff;
+        d = (d | (d >> 8)) & 0x0000ffff;
+        return d;
+    }
+
+    PixelOffset mortonPoint(unsigned d)
+    {
+        return PixelOffset{ compactBits(d), compactBits(d >> 1) };
+    }
+
+    // Position of the d-th point of the Hilbert curve through an n x n grid
+    PixelOffset hilbertPoint(unsigned n, unsigned d)
+    {
+        unsigned x = 0;
+        unsigned y = 0;
+        for (unsigned s = 1; s < n; s *= 2)
+        {
+            unsigned rx = 1 & (d / 2);
+            unsigned ry = 1 & (d ^ rx);
+
+            // rotate the quadrant
+            if (ry == 0)
+            {
+                if (rx == 1)
+                {
+                    x = s - 1 - x;
+                    y = s - 1 - y;
+                }
+                swap(x, y);
+            }
+
+            x += s * rx;
+            y += s * ry;
+            d /= 4;
+        }
+        return PixelOffset{ x, y };
+    }
+}
+
+vector<PixelOffset> tileOrder(Traversal order, unsigned tileSize)
+{
+    // The curves need a power of two grid, points outside the tile are
+    // dropped which keeps the order of the remaining ones.
+    unsigned n = 1;
+    while (n < tileSize)
+        n *= 2;
+
+    vector<PixelOffset> offsets;
+    offsets.reserve(tileSize * tileSize);
+    for (unsigned d = 0; d != n * n; ++d)
+    {
+        PixelOffset p;
+        switch (order)
+        {
+            case Traversal::Morton:  p = mortonPoint(d);     break;
+            case Traversal::Hilbert: p = hilbertPoint(n, d); break;
+            default:                 p = PixelOffset{ d % n, d / n }; break;
+        }
+        if (p.x < tileSize && p.y < tileSize)
+            offsets.push_back(p);
+    }
+    return offsets;
+}
@@ -0,0 +1,31 @@
+#ifndef TRAVERSAL_H_
+#define TRAVERSAL_H_
+
+#include <string>
+#include <vector>
+
+// Order in which Scene::render visits the pixels. RowMajor walks whole image
+// rows, the other orders split the image into square tiles and follow a
+// space filling curve inside each tile, so consecutive primary rays stay
+// close together and hit the same geometry. Every ray still tests every
+// object, so they measure no faster than RowMajor (Bench/traversal.cpp).
+enum class Traversal
+{
+    RowMajor,
+    Morton,     // Z-order
+    Hilbert
+};
+
+// "rowmajor", "morton" or "hilbert", throws on anything else
+Traversal parseTraversal(std::string const &name);
+
+struct PixelOffset
+{
+    unsigned x;
+    unsigned y;
+};
+
+// Offsets of the pixels of a tileSize x tileSize tile in visiting order
+std::vector<PixelOffset> tileOrder(Traversal order, unsigned tileSize);
+
+#endif
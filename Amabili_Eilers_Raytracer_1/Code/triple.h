@@ -1,100 +1,334 @@
 #ifndef TRIPLE_H_
 #define TRIPLE_H_
 
+#include "precision.h"
+#include "simd.h"
+
 #include "json/json_fwd.h"
 
+#include <cmath>        // fmin, sqrt
 #include <iosfwd>
 
+// Triple is a template over its scalar type, the pipeline uses the Real
+// instantiation (see precision.h). All math is inline below so it can be
+// inlined and vectorized at the call site, only the json constructor and
+// the IO operators live in triple.cpp.
+template <typename T>
+class TripleT;
+
 // Color, Point and Vector are all Triples (name them so)
-class Triple;
+typedef TripleT<Real> Triple;
 typedef Triple Color;
 typedef Triple Point;
 typedef Triple Vector;
 
-class Triple
+template <typename T>
+class alignas(tripleAlignment<T>()) TripleT
 {
     public:
+        typedef T value_type;
+
 // --- data members ------------------------------------------------------------
 
         // union to acces the same elements by
         // x, y, z, or r, g, b or data[index]
+        // With the padded layout data[3] is an unused fourth lane.
         union {
-            double data[3];
+            T data[TRIPLE_LANES];
             struct {
-                double x;
-                double y;
-                double z;
+                T x;
+                T y;
+                T z;
             };
             struct {
-                double r;
-                double g;
-                double b;
+                T r;
+                T g;
+                T b;
             };
         };
 
 // --- Constructors ------------------------------------------------------------
 
-        explicit Triple(double X = 0, double Y = 0, double Z = 0);
-        explicit Triple(nlohmann::json const &node);    // json -> Triple
+        explicit TripleT(T X = 0, T Y = 0, T Z = 0);
+        explicit TripleT(nlohmann::json const &node);   // json -> Triple
 
 // --- Operators ---------------------------------------------------------------
 
-        Triple operator+(Triple const &t) const;// add two triples
-        Triple operator+(double f) const;       // add a value to each member
+        TripleT operator+(TripleT const &t) const;// add two triples
+        TripleT operator+(T f) const;           // add a value to each member
                                                 // of a triple
-        Triple operator-() const;               // negate
-        Triple operator-(Triple const &t) const;// subtract two triples
-        Triple operator-(double f) const;       // subtract a value from each
+        TripleT operator-() const;              // negate
+        TripleT operator-(TripleT const &t) const;// subtract two triples
+        TripleT operator-(T f) const;           // subtract a value from each
                                                 // member
 
-        Triple operator*(Triple const &t) const;// memberwise multiplication
-        Triple operator*(double f) const;       // multiply each member with a
+        TripleT operator*(TripleT const &t) const;// memberwise multiplication
+        TripleT operator*(T f) const;           // multiply each member with a
                                                 // value
-        Triple operator/(double f) const;       // divide each member by a value
+        TripleT operator/(T f) const;           // divide each member by a value
 
 // --- Compound operators ------------------------------------------------------
 
-        Triple &operator+=(Triple const &t);
-        Triple &operator+=(double f);
+        TripleT &operator+=(TripleT const &t);
+        TripleT &operator+=(T f);
 
-        Triple &operator-=(Triple const &t);
-        Triple &operator-=(double f);
+        TripleT &operator-=(TripleT const &t);
+        TripleT &operator-=(T f);
 
-        Triple &operator*=(double f);
-        Triple &operator/=(double f);
+        TripleT &operator*=(T f);
+        TripleT &operator/=(T f);
 
 // --- Vector Operators --------------------------------------------------------
 
-        double dot(Triple const &t) const;      // dot product
-        Triple cross(Triple const &t) const;    // cross product
+        T dot(TripleT const &t) const;          // dot product
+        TripleT cross(TripleT const &t) const;  // cross product
 
-        double length() const;
-        double length_2() const;                // length squared
+        T length() const;
+        T length_2() const;                     // length squared
 
         // NOTE: normalized return a COPY, normalize does NOT
-        Triple normalized() const;              // normalized COPY
+        TripleT normalized() const;             // normalized COPY
         void normalize();                       // normalize THIS
 
 // --- Color functions ---------------------------------------------------------
 
-        void set(double f);                     // set all values to f
-        void set(double f, double maxValue);    // set all values to f / maxVal
-        void set(double red, double green, double blue);
-        void set(double red, double green, double blue, double maxValue);
+        void set(T f);                          // set all values to f
+        void set(T f, T maxValue);              // set all values to f / maxVal
+        void set(T red, T green, T blue);
+        void set(T red, T green, T blue, T maxValue);
 
-        void clamp(double maxValue = 1.0);      // clamp: fmin(val, maxValue)
+        void clamp(T maxValue = 1.0);           // clamp: fmin(val, maxValue)
 
 };
 
+// --- Constructors ------------------------------------------------------------
+
+template <typename T>
+inline TripleT<T>::TripleT(T X, T Y, T Z)
+{
+    data[0] = X;
+    data[1] = Y;
+    data[2] = Z;
+    for (unsigned idx = 3; idx < TRIPLE_LANES; ++idx)
+        data[idx] = 0;
+}
+
+// --- Operators ---------------------------------------------------------------
+
+template <typename T>
+inline TripleT<T> TripleT<T>::operator+(TripleT const &t) const
+{
+    TripleT out;
+    Lanes<T, TRIPLE_LANES>::add(out.data, data, t.data);
+    return out;
+}
+
+template <typename T>
+inline TripleT<T> TripleT<T>::operator+(T f) const
+{
+    TripleT out;
+    Lanes<T, TRIPLE_LANES>::offset(out.data, data, f);
+    return out;
+}
+
+template <typename T>
+inline TripleT<T> TripleT<T>::operator-() const
+{
+    TripleT out;
+    Lanes<T, TRIPLE_LANES>::neg(out.data, data);
+    return out;
+}
+
+template <typename T>
+inline TripleT<T> TripleT<T>::operator-(TripleT const &t) const
+{
+    TripleT out;
+    Lanes<T, TRIPLE_LANES>::sub(out.data, data, t.data);
+    return out;
+}
+
+template <typename T>
+inline TripleT<T> TripleT<T>::operator-(T f) const
+{
+    return *this + (-f);
+}
+
+template <typename T>
+inline TripleT<T> TripleT<T>::operator*(TripleT const &t) const
+{
+    TripleT out;
+    Lanes<T, TRIPLE_LANES>::mul(out.data, data, t.data);
+    return out;
+}
+
+template <typename T>
+inline TripleT<T> TripleT<T>::operator*(T f) const
+{
+    TripleT out;
+    Lanes<T, TRIPLE_LANES>::scale(out.data, data, f);
+    return out;
+}
+
+template <typename T>
+inline TripleT<T> TripleT<T>::operator/(T f) const
+{
+    T invf = 1.0 / f;
+    return *this * invf;
+}
+
+// --- Compound operators ------------------------------------------------------
+
+template <typename T>
+inline TripleT<T> &TripleT<T>::operator+=(TripleT const &t)
+{
+    Lanes<T, TRIPLE_LANES>::add(data, data, t.data);
+    return *this;
+}
+
+template <typename T>
+inline TripleT<T> &TripleT<T>::operator+=(T f)
+{
+    Lanes<T, TRIPLE_LANES>::offset(data, data, f);
+    return *this;
+}
+
+template <typename T>
+inline TripleT<T> &TripleT<T>::operator-=(TripleT const &t)
+{
+    Lanes<T, TRIPLE_LANES>::sub(data, data, t.data);
+    return *this;
+}
+
+template <typename T>
+inline TripleT<T> &TripleT<T>::operator-=(T f)
+{
+    Lanes<T, TRIPLE_LANES>::offset(data, data, -f);
+    return *this;
+}
+
+template <typename T>
+inline TripleT<T> &TripleT<T>::operator*=(T f)
+{
+    Lanes<T, TRIPLE_LANES>::scale(data, data, f);
+    return *this;
+}
+
+template <typename T>
+inline TripleT<T> &TripleT<T>::operator/=(T f)
+{
+    T invf = 1.0 / f;
+    return *this *= invf;
+}
+
+// --- Vector Operators --------------------------------------------------------
+
+template <typename T>
+inline T TripleT<T>::dot(TripleT const &t) const
+{
+    return x * t.x + y * t.y + z * t.z;
+}
+
+template <typename T>
+inline TripleT<T> TripleT<T>::cross(TripleT const &t) const
+{
+    return TripleT(y*t.z - z*t.y,
+                   z*t.x - x*t.z,
+                   x*t.y - y*t.x);
+}
+
+template <typename T>
+inline T TripleT<T>::length() const
+{
+    return std::sqrt(length_2());
+}
+
+template <typename T>
+inline T TripleT<T>::length_2() const
+{
+    return x * x + y * y + z * z;
+}
+
+template <typename T>
+inline TripleT<T> TripleT<T>::normalized() const
+{
+    return (*this) / length();
+}
+
+template <typename T>
+inline void TripleT<T>::normalize()
+{
+    T len = length();
+    T invlen = 1.0 / len;
+    *this *= invlen;
+}
+
+// --- Color functions ---------------------------------------------------------
+
+template <typename T>
+inline void TripleT<T>::set(T f)
+{
+    r = f;
+    g = f;
+    b = f;
+}
+
+template <typename T>
+inline void TripleT<T>::set(T f, T maxValue)
+{
+    set(f / maxValue);
+}
+
+template <typename T>
+inline void TripleT<T>::set(T red, T green, T blue)
+{
+    r = red;
+    g = green;
+    b = blue;
+}
+
+template <typename T>
+inline void TripleT<T>::set(T red, T green, T blue, T maxValue)
+{
+    set(red / maxValue, green / maxValue, blue / maxValue);
+}
+
+template <typename T>
+inline void TripleT<T>::clamp(T maxValue)
+{
+    r = std::fmin(r, maxValue);
+    g = std::fmin(g, maxValue);
+    b = std::fmin(b, maxValue);
+}
+
 // --- Free Operators ----------------------------------------------------------
 
-Triple operator+(double f, Triple const &t);
-Triple operator-(double f, Triple const &t);
-Triple operator*(double f, Triple const &t);
+// The scalar is not deduced, so e.g. 2 * triple works for any T
+template <typename T>
+inline TripleT<T> operator+(typename TripleT<T>::value_type f,
+                            TripleT<T> const &t)
+{
+    return t + f;
+}
+
+template <typename T>
+inline TripleT<T> operator-(typename TripleT<T>::value_type f,
+                            TripleT<T> const &t)
+{
+    return -t + f;
+}
+
+template <typename T>
+inline TripleT<T> operator*(typename TripleT<T>::value_type f,
+                            TripleT<T> const &t)
+{
+    return t * f;
+}
 
 // --- IO Operators ------------------------------------------------------------
 
-std::istream &operator>>(std::istream &is, Triple &t);
-std::ostream &operator<<(std::ostream &os, Triple const &t);
+template <typename T>
+std::istream &operator>>(std::istream &is, TripleT<T> &t);
+template <typename T>
+std::ostream &operator<<(std::ostream &os, TripleT<T> const &t);
 
 #endif
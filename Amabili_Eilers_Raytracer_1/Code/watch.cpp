@@ -0,0 +1,70 @@
+#include "watch.h"
+
+#include "hash.h"
+#include "jsonstream.h"
+
+#include "json/json.h"
+
+#include <sys/stat.h>
+
+#include <fstream>
+#include <stdexcept>
+
+using namespace std;
+using json = nlohmann::json;
+
+namespace
+{
+    // object members are sorted, so equal values dump the same
+    uint64_t mix(uint64_t hash, string const &data)
+    {
+        for (unsigned char ch : data)
+            hash = fnv1a(hash, ch);
+        return fnv1a(hash, 0);
+    }
+}
+
+SceneDigest digestScene(string const &filename)
+{
+    ifstream in(filename, ios::binary);
+    if (!in)
+        throw runtime_error("Could not open " + filename);
+
+    SceneDigest digest;
+    digest.settings = FNV1A_OFFSET;
+    digest.lights = FNV1A_OFFSET;
+
+    JsonStreamReader reader(in);
+    reader.read({"Objects", "Lights"},
+        [&](string const &key, json const &value)
+        {
+            digest.settings = mix(mix(digest.settings, key), value.dump());
+        },
+        [&](string const &key, json const &element)
+        {
+            if (key == "Lights")
+            {
+                digest.lights = mix(digest.lights, element.dump());
+                return;
+            }
+            json shape = element;
+            uint64_t material = FNV1A_OFFSET;
+            if (shape.is_object() && shape.count("material"))
+            {
+                material = mix(material, shape["material"].dump());
+                shape.erase("material");
+            }
+            digest.shapes.push_back(mix(FNV1A_OFFSET, shape.dump()));
+            digest.materials.push_back(material);
+        });
+    return digest;
+}
+
+pair<int64_t, int64_t> fileVersion(string const &filename)
+{
+    struct stat info;
+    if (stat(filename.c_str(), &info) != 0)
+        return make_pair(-1, -1);
+    return make_pair(int64_t(info.st_mtim.tv_sec) * 1000000000
+                     + info.st_mtim.tv_nsec, int64_t(info.st_size));
+}
@@ -0,0 +1,26 @@
+#ifndef WATCH_H_
+#define WATCH_H_
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Fingerprint of a scene file for the watch mode (Raytracer::watch): what
+// differs between two versions decides how much has to be traced again
+struct SceneDigest
+{
+    uint64_t settings = 0;              // every member but Objects, Lights
+    uint64_t lights = 0;
+    std::vector<uint64_t> shapes;       // per "Objects" element, without
+    std::vector<uint64_t> materials;    // its material, and the material
+};
+
+// Throws runtime_error (or a json exception) if the file cannot be read
+SceneDigest digestScene(std::string const &filename);
+
+// Modification time (ns) and size of filename, anything else than last time
+// means the file was written; (-1, -1) if it cannot be stat'ed
+std::pair<int64_t, int64_t> fileVersion(std::string const &filename);
+
+#endif